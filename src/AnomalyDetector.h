@@ -0,0 +1,122 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "Measurement.h"
+
+enum class AnomalyAction { Flag, Reject };
+
+struct AnomalyReport {
+    MeasurementType type;
+    float value;
+    float median;
+    float score;
+    bool rejected;
+};
+
+// Modified z-score (Iglewicz & Hoaglin): 0.6745 * (x - median) / MAD over a
+// rolling window of recent samples. Every sample, outliers included, enters
+// the window afterwards, so a one-off spike never moves the median while a
+// genuine level shift is accepted once it fills half the window.
+class RobustZScore {
+public:
+    static constexpr size_t window = 15;
+    static constexpr size_t min_samples = 7;
+
+private:
+    std::array<float, window> samples_{};
+    size_t head_ = 0;
+    size_t size_ = 0;
+
+    static float medianOf(std::array<float, window>& values, size_t count) {
+        std::sort(values.begin(), values.begin() + count);
+        return count % 2 ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+    }
+
+public:
+    // Scores `x` against the window, then adds it. Returns 0 until the window has
+    // `min_samples`. `mad_floor(median)` keeps a perfectly flat signal from turning
+    // every small step into an outlier.
+    template <typename MadFloor>
+    float score(float x, MadFloor&& mad_floor, float& median) {
+        float result = 0;
+        median = x;
+
+        if (size_ >= min_samples) {
+            std::array<float, window> sorted = samples_;
+            median = medianOf(sorted, size_);
+
+            std::array<float, window> deviations{};
+            for (size_t i = 0; i < size_; i++) {
+                deviations[i] = std::fabs(samples_[i] - median);
+            }
+            const float mad = std::max(medianOf(deviations, size_), mad_floor(median));
+            result = 0.6745f * (x - median) / mad;
+        }
+
+        samples_[head_] = x;
+        head_ = (head_ + 1) % window;
+        if (size_ < window) size_++;
+        return result;
+    }
+};
+
+// Screens raw samples for spikes before they reach the filters and the
+// consumers. Bounded work per value: two sorts of at most `window` floats.
+class AnomalyDetector {
+public:
+    static constexpr float threshold = 3.5f;
+
+private:
+    std::array<RobustZScore, measurement_type_count> series_{};
+    std::array<AnomalyAction, measurement_type_count> actions_{};
+
+    // The smallest MAD worth scoring against: about one sensor resolution
+    // step, or 5% of the median for the types whose noise scales with level.
+    static float madFloorOf(MeasurementType type, float median) {
+        switch (type) {
+            case MeasurementType::Temperature: return 0.1f;
+            case MeasurementType::Humidity: return 0.5f;
+            case MeasurementType::CO2: return std::max(10.0f, 0.05f * std::fabs(median));
+            default: return std::max(3.0f, 0.05f * std::fabs(median));
+        }
+    }
+
+public:
+    // The PMS is read once per report interval, so a real change in PM takes half a
+    // window, about 40 minutes at the default, to be accepted. Rejecting it until then
+    // would drop real pollution; PM outliers are only flagged.
+    AnomalyDetector() {
+        actions_.fill(AnomalyAction::Reject);
+        setAction(MeasurementType::PM1, AnomalyAction::Flag);
+        setAction(MeasurementType::PM25, AnomalyAction::Flag);
+        setAction(MeasurementType::PM10, AnomalyAction::Flag);
+    }
+
+    void setAction(MeasurementType type, AnomalyAction action) {
+        actions_[static_cast<size_t>(type)] = action;
+    }
+
+    // Scores every value in `frame`. Outliers are passed to `on_anomaly(const AnomalyReport&)`
+    // and, for types set to Reject, removed from the frame.
+    template <typename OnAnomaly>
+    void screen(SampleFrame& frame, OnAnomaly&& on_anomaly) {
+        for (size_t index = 0; index < measurement_type_count; index++) {
+            const MeasurementType type = static_cast<MeasurementType>(index);
+            if (!frame.has(type)) continue;
+
+            const float value = static_cast<float>(frame.get(type));
+            float median = value;
+            const float score = series_[index].score(value, [type](float m) { return madFloorOf(type, m); }, median);
+            if (std::fabs(score) <= threshold) continue;
+
+            const bool rejected = actions_[index] == AnomalyAction::Reject;
+            if (rejected) frame.remove(type);
+            on_anomaly(AnomalyReport{ type, value, median, score, rejected });
+        }
+    }
+};
@@ -1,10 +1,8 @@
 #pragma once
 
 #include <atomic>
-#include <memory>
 #include <mutex>
 #include <string>
-#include <vector>
 
 #include <Arduino.h>
 #include "Measurement.h"
@@ -16,13 +14,16 @@ struct AppState {
     std::atomic<uint8_t>  fan_speed_percent{20};
     std::atomic<bool>     display_enabled{true};
     std::atomic<bool>     ota_in_progress{false};
+    std::atomic<uint32_t> loop_stack_free{0}; // bytes the loop task's stack never reached
 
     // ── Shared hardware mutex ──────────────────────────────────
     std::mutex i2c_mutex;
 
     // ── Sensor data ────────────────────────────────────────────
-    std::vector<std::unique_ptr<Measurement>> measurements;
+    SampleFrame measurements;
     std::mutex measurements_mutex;
+    // Mirrors measurements.generation, so consumers can poll for news without taking the mutex.
+    std::atomic<uint32_t> measurements_generation{0};
 
     // ── Runtime state ──────────────────────────────────────────
     bool is_setup = false;
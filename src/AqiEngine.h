@@ -0,0 +1,226 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "Measurement.h"
+
+struct AqiSummary {
+    bool valid;
+    float nowcast_pm25;   // µg/m³, EPA NowCast over the last 12 hours
+    float nowcast_pm10;
+    uint16_t aqi_pm25;    // US EPA sub-indices from the NowCast values
+    uint16_t aqi_pm10;
+    uint16_t aqi;         // the larger of the two
+    uint8_t caqi;         // EU CAQI (hourly grid) from the current hour, capped at 100
+    float average_pm25;   // rolling 24 h means
+    float average_pm10;
+    const char* category; // US EPA category of `aqi`
+    const char* short_category; // the same in at most 21 characters, one line on the display
+};
+
+// Air quality indices from PM2.5/PM10 samples. Samples are summed into 24
+// hourly buckets in a fixed circular buffer; each sample is O(1) and a
+// summary only looks at those 24 buckets.
+//
+// - US EPA NowCast: hourly means of the last 12 hours weighted by
+//   w^(hours ago), w = max(min/max, 0.5). Needs data in two of the last three hours.
+//   AQI breakpoints are the 2024 revision for PM2.5.
+// - EU CAQI: hourly grid applied to the current hour's mean.
+class AqiEngine {
+public:
+    static constexpr size_t hour_count = 24;
+    static constexpr size_t nowcast_hours = 12;
+
+private:
+    struct HourBucket {
+        float pm25_sum = 0;
+        float pm10_sum = 0;
+        uint16_t count = 0;
+    };
+
+    struct Breakpoint {
+        float concentration_low;
+        float concentration_high;
+        uint16_t index_low;
+        uint16_t index_high;
+    };
+
+    static constexpr std::array<Breakpoint, 6> epa_pm25 = {{
+        { 0.0f, 9.0f, 0, 50 },
+        { 9.1f, 35.4f, 51, 100 },
+        { 35.5f, 55.4f, 101, 150 },
+        { 55.5f, 125.4f, 151, 200 },
+        { 125.5f, 225.4f, 201, 300 },
+        { 225.5f, 325.4f, 301, 500 }
+    }};
+
+    static constexpr std::array<Breakpoint, 6> epa_pm10 = {{
+        { 0, 54, 0, 50 },
+        { 55, 154, 51, 100 },
+        { 155, 254, 101, 150 },
+        { 255, 354, 151, 200 },
+        { 355, 424, 201, 300 },
+        { 425, 604, 301, 500 }
+    }};
+
+    static constexpr std::array<Breakpoint, 4> caqi_pm25 = {{
+        { 0, 15, 0, 25 },
+        { 15, 30, 25, 50 },
+        { 30, 55, 50, 75 },
+        { 55, 110, 75, 100 }
+    }};
+
+    static constexpr std::array<Breakpoint, 4> caqi_pm10 = {{
+        { 0, 25, 0, 25 },
+        { 25, 50, 25, 50 },
+        { 50, 90, 50, 75 },
+        { 90, 180, 75, 100 }
+    }};
+
+    std::array<HourBucket, hour_count> buckets_{};
+    uint32_t current_hour_ = 0;
+    bool started_ = false;
+    mutable std::mutex mutex_;
+
+    // Hourly bucket `hours_ago` hours before `now_hour`. Hours after the last
+    // sample, or older than the buffer, are empty.
+    HourBucket bucketAt(uint32_t now_hour, size_t hours_ago) const {
+        const uint32_t stale_hours = now_hour > current_hour_ ? now_hour - current_hour_ : 0;
+        if (hours_ago < stale_hours || hours_ago - stale_hours >= hour_count) return HourBucket{};
+        return buckets_[(current_hour_ + hour_count - (hours_ago - stale_hours)) % hour_count];
+    }
+
+    void advanceTo(uint32_t hour) {
+        if (!started_ || hour < current_hour_ || hour - current_hour_ >= hour_count) {
+            // First sample or the clock jumped (e.g. SNTP sync): start over.
+            buckets_ = {};
+        } else {
+            for (uint32_t h = current_hour_ + 1; h <= hour; h++) {
+                buckets_[h % hour_count] = HourBucket{};
+            }
+        }
+        current_hour_ = hour;
+        started_ = true;
+    }
+
+    template <size_t N>
+    static uint16_t interpolate(const std::array<Breakpoint, N>& table, float concentration) {
+        for (const Breakpoint& bp : table) {
+            if (concentration <= bp.concentration_high) {
+                if (concentration < bp.concentration_low) concentration = bp.concentration_low;
+                return static_cast<uint16_t>(std::lround(
+                    (bp.index_high - bp.index_low) / (bp.concentration_high - bp.concentration_low) *
+                    (concentration - bp.concentration_low) + bp.index_low));
+            }
+        }
+        return table.back().index_high;
+    }
+
+    // Returns a negative value if there is not enough recent data.
+    float nowcast(uint32_t now_hour, bool pm25) const {
+        std::array<float, nowcast_hours> means{};
+        std::array<bool, nowcast_hours> present{};
+        float minimum = 0;
+        float maximum = 0;
+        bool any = false;
+
+        for (size_t i = 0; i < nowcast_hours; i++) {
+            const HourBucket bucket = bucketAt(now_hour, i);
+            if (bucket.count == 0) continue;
+            means[i] = (pm25 ? bucket.pm25_sum : bucket.pm10_sum) / bucket.count;
+            present[i] = true;
+            if (!any || means[i] < minimum) minimum = means[i];
+            if (!any || means[i] > maximum) maximum = means[i];
+            any = true;
+        }
+
+        if (present[0] + present[1] + present[2] < 2) return -1;
+
+        float weight = maximum > 0 ? minimum / maximum : 1;
+        if (weight < 0.5f) weight = 0.5f;
+
+        float weighted_sum = 0;
+        float weight_sum = 0;
+        float factor = 1;
+        for (size_t i = 0; i < nowcast_hours; i++, factor *= weight) {
+            if (!present[i]) continue;
+            weighted_sum += factor * means[i];
+            weight_sum += factor;
+        }
+        return weighted_sum / weight_sum;
+    }
+
+    static const char* categoryOf(uint16_t aqi) {
+        if (aqi <= 50) return "Good";
+        if (aqi <= 100) return "Moderate";
+        if (aqi <= 150) return "Unhealthy for sensitive groups";
+        if (aqi <= 200) return "Unhealthy";
+        if (aqi <= 300) return "Very unhealthy";
+        return "Hazardous";
+    }
+
+    static const char* shortCategoryOf(uint16_t aqi) {
+        if (aqi > 100 && aqi <= 150) return "Unhealthy (sensitive)";
+        return categoryOf(aqi);
+    }
+
+public:
+    // Uses the PM2.5/PM10 slots of `frame`, if both are present.
+    void add(const SampleFrame& frame, uint32_t time) {
+        if (!frame.has(MeasurementType::PM25) || !frame.has(MeasurementType::PM10)) return;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        advanceTo(time / 3600);
+        HourBucket& bucket = buckets_[current_hour_ % hour_count];
+        bucket.pm25_sum += frame.get(MeasurementType::PM25);
+        bucket.pm10_sum += frame.get(MeasurementType::PM10);
+        bucket.count++;
+    }
+
+    // Judged at `time`, so the summary turns invalid once the PM data stops coming in.
+    AqiSummary summary(uint32_t time) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        AqiSummary result{};
+        if (!started_) return result;
+
+        const uint32_t now_hour = time / 3600;
+        const float pm25 = nowcast(now_hour, true);
+        const float pm10 = nowcast(now_hour, false);
+        if (pm25 < 0 || pm10 < 0) return result;
+
+        // EPA truncates NowCast to 0.1 µg/m³ for PM2.5 and 1 µg/m³ for PM10.
+        result.nowcast_pm25 = std::floor(pm25 * 10) / 10;
+        result.nowcast_pm10 = std::floor(pm10);
+        result.aqi_pm25 = interpolate(epa_pm25, result.nowcast_pm25);
+        result.aqi_pm10 = interpolate(epa_pm10, result.nowcast_pm10);
+        result.aqi = result.aqi_pm25 > result.aqi_pm10 ? result.aqi_pm25 : result.aqi_pm10;
+        result.category = categoryOf(result.aqi);
+        result.short_category = shortCategoryOf(result.aqi);
+
+        const HourBucket current = bucketAt(now_hour, 0);
+        if (current.count > 0) {
+            const uint16_t caqi25 = interpolate(caqi_pm25, current.pm25_sum / current.count);
+            const uint16_t caqi10 = interpolate(caqi_pm10, current.pm10_sum / current.count);
+            result.caqi = static_cast<uint8_t>(caqi25 > caqi10 ? caqi25 : caqi10);
+        }
+
+        float pm25_sum = 0;
+        float pm10_sum = 0;
+        uint32_t count = 0;
+        for (size_t i = 0; i < hour_count; i++) {
+            const HourBucket bucket = bucketAt(now_hour, i);
+            pm25_sum += bucket.pm25_sum;
+            pm10_sum += bucket.pm10_sum;
+            count += bucket.count;
+        }
+        result.average_pm25 = pm25_sum / count;
+        result.average_pm10 = pm10_sum / count;
+
+        result.valid = true;
+        return result;
+    }
+};
@@ -12,6 +12,7 @@ namespace keys {
     constexpr const char* mqtt_port         = "mqtt_port";
     constexpr const char* mqtt_user         = "mqtt_user";
     constexpr const char* mqtt_pass         = "mqtt_pass";
+    constexpr const char* mqtt_replay_rate  = "mqtt_replay";
     constexpr const char* friendly_name     = "friendly_name";
     constexpr const char* host_name         = "host_name";
     constexpr const char* report_interval   = "report_interval";
@@ -22,6 +23,9 @@ namespace keys {
     constexpr const char* syslog_server_port = "syslog_port";
     constexpr const char* log_level         = "log_level";
     constexpr const char* ha_discovery_prefix = "ha_prefix";
+    constexpr const char* ha_per_entity_topics = "ha_per_entity";
+    constexpr const char* ha_device_discovery = "ha_device_disco";
+    constexpr const char* ha_device_discovery_active = "ha_disco_dev"; // mode the broker holds, not user facing
 }
 
 namespace defaults {
@@ -31,6 +35,7 @@ namespace defaults {
     constexpr uint16_t    mqtt_port         = 1883;
     constexpr const char* mqtt_user         = "";
     constexpr const char* mqtt_pass         = "";
+    constexpr uint8_t     mqtt_replay_rate  = 2;   // backlog messages per second
     constexpr const char* friendly_name     = "Smart Air Quality Monitor";
     constexpr const char* host_name         = "smaq";
     constexpr uint32_t    report_interval   = 5;   // minutes
@@ -41,6 +46,9 @@ namespace defaults {
     constexpr uint16_t    syslog_server_port = 514;
     constexpr const char* log_level         = "Error";
     constexpr const char* ha_discovery_prefix = "homeassistant";
+    constexpr bool        ha_per_entity_topics = false;
+    constexpr bool        ha_device_discovery = false;
+    constexpr bool        ha_device_discovery_active = false;
 }
 
 }
@@ -4,35 +4,41 @@
 
 #include "Sensor.h"
 #include "Logger.h"
+#include <array>
+#include <atomic>
 #include <mutex>
 
+// Split-phase DHT20 driver: the measurement is triggered under the bus mutex,
+// the bus is released for the ~80ms conversion, and the result is fetched
+// under the mutex again once the conversion deadline has passed.
 class DHT20Wrapper : public SensorDriver {
 
+public:
+    static constexpr const char* name = "DHT20";
+    static constexpr std::array<SensorEntity, 2> entities = {{
+        { MeasurementType::Temperature, "temp", "Temperature", "temperature", "°C" },
+        { MeasurementType::Humidity, "hum", "Humidity", "humidity", "%" }
+    }};
+
 private:
+    static constexpr uint32_t conversion_duration_millis = 80;
+
     DHT20 sensor;
-    const MeasurementDetails temperature_sensor_details = MeasurementDetails(MeasurementType::Temperature, MeasurementUnit::DegreesCelsius);
-    const MeasurementDetails humidity_sensor_details = MeasurementDetails(MeasurementType::Humidity, MeasurementUnit::Percent);
     std::mutex& i2c_mutex;
+    int request_status = DHT20_OK;
 
-public:
-    DHT20Wrapper(std::mutex& i2c_mutex) : i2c_mutex(i2c_mutex) {}
-    bool begin() override {
-        std::lock_guard<std::mutex> lock(i2c_mutex);
-        return sensor.begin();
-    }
+    std::atomic<uint32_t> last_lock_hold_micros{0};
+    std::atomic<uint32_t> max_lock_hold_micros{0};
 
-    bool provideMeasurements(std::vector<std::unique_ptr<Measurement>>& measurements) override {
-        int status;
-        {
-            std::lock_guard<std::mutex> lock(i2c_mutex);
-            status = sensor.read();
+    void recordLockHold(uint32_t hold_micros) {
+        last_lock_hold_micros.store(hold_micros);
+        if (hold_micros > max_lock_hold_micros.load()) {
+            max_lock_hold_micros.store(hold_micros);
         }
+    }
 
+    void logError(int status) {
         switch (status) {
-            case DHT20_OK:
-                measurements.push_back(std::make_unique<DecimalMeasurement>(humidity_sensor_details, sensor.getHumidity()));
-                measurements.push_back(std::make_unique<DecimalMeasurement>(temperature_sensor_details, sensor.getTemperature()));
-                return true;
             case DHT20_ERROR_CHECKSUM:
                 logger.log(Logger::Level::Error, "Reading DHT20 failed: Checksum error");
                 break;
@@ -40,7 +46,7 @@ public:
                 logger.log(Logger::Level::Error, "Reading DHT20 failed: Connect error");
                 break;
             case DHT20_MISSING_BYTES:
-            logger.log(Logger::Level::Error, "Reading DHT20 failed: Missing bytes");
+                logger.log(Logger::Level::Error, "Reading DHT20 failed: Missing bytes");
                 break;
             case DHT20_ERROR_BYTES_ALL_ZERO:
                 logger.log(Logger::Level::Error, "Reading DHT20 failed: All bytes read zero");
@@ -55,8 +61,62 @@ public:
                 logger.log(Logger::Level::Error, "Reading DHT20 failed: Unknown error");
                 break;
         }
+    }
+
+public:
+    DHT20Wrapper(std::mutex& i2c_mutex) : i2c_mutex(i2c_mutex) {}
+    bool begin() {
+        std::lock_guard<std::mutex> lock(i2c_mutex);
+        return sensor.begin();
+    }
+
+    uint32_t wake() {
+        std::lock_guard<std::mutex> lock(i2c_mutex);
+        const uint32_t start = micros();
+        request_status = sensor.requestData();
+        recordLockHold(micros() - start);
+        return conversion_duration_millis;
+    }
+
+    ReadStatus read(uint32_t now, SampleFrame& frame) {
+        if (request_status != DHT20_OK) {
+            logger.log(Logger::Level::Error, "Reading DHT20 failed: Could not trigger measurement");
+            return ReadStatus::Failed;
+        }
+
+        int rv;
+        {
+            std::lock_guard<std::mutex> lock(i2c_mutex);
+            const uint32_t start = micros();
+            // Still busy: the bytes read now would be stale, fail this cycle instead.
+            rv = sensor.isMeasuring() ? DHT20_ERROR_READ_TIMEOUT : sensor.readData();
+            recordLockHold(micros() - start);
+        }
+
+        // readData() returns the byte count or a negative error. convert() works on the
+        // bytes of the last successful read, which still pass the CRC, so skip it on failure.
+        if (rv < 0) {
+            logError(rv);
+            return ReadStatus::Failed;
+        }
+
+        const int status = sensor.convert();
+        if (status == DHT20_OK) {
+            frame.set(MeasurementType::Humidity, sensor.getHumidity(), now);
+            frame.set(MeasurementType::Temperature, sensor.getTemperature(), now);
+            return ReadStatus::Ok;
+        }
+
+        logError(status);
+        return ReadStatus::Failed;
+    }
+
+    uint32_t getLastLockHoldMicros() const {
+        return last_lock_hold_micros.load();
+    }
 
-        return false;
+    uint32_t getMaxLockHoldMicros() const {
+        return max_lock_hold_micros.load();
     }
 
 };
\ No newline at end of file
@@ -136,18 +136,17 @@ public:
         display_.display();
     }
 
-    void show(const std::unique_ptr<Measurement>& measurement) {
+    void show(MeasurementType m_type, const SampleFrame& frame) {
         if (!is_setup_ || !is_enabled_) return;
 
-        MeasurementType m_type = measurement->getDetails().getType();
-        
-        std::string_view type_name_sv = measurement_type_translator_->translate(m_type);
-        std::string type_name(type_name_sv.data(), type_name_sv.length());
-        
-        std::string value = measurement->valueToString();
-        
-        std::string_view unit_sv = measurement_unit_translator_->translate(measurement->getDetails().getUnit());
-        std::string unit(unit_sv.data(), unit_sv.length());
+        const std::string_view type_name = measurement_type_translator_->translate(m_type);
+        const std::string_view unit = measurement_unit_translator_->translate(unitOf(m_type));
+
+        char value[16];
+        frame.formatValue(m_type, value, sizeof(value));
+
+        char val_unit[24];
+        snprintf(val_unit, sizeof(val_unit), "%s%.*s", value, (int)unit.length(), unit.data());
         
         const uint8_t* icon = getIconForType(m_type);
 
@@ -155,11 +154,10 @@ public:
         display_.clearDisplay();
         drawStatusBar();
 
-        std::string val_unit = value + unit;
         int16_t x1, y1;
         uint16_t w_val, h_val;
         display_.setTextSize(2);
-        display_.getTextBounds(val_unit.c_str(), 0, 0, &x1, &y1, &w_val, &h_val);
+        display_.getTextBounds(val_unit, 0, 0, &x1, &y1, &w_val, &h_val);
         
         int icon_w = 32;
         int icon_h = 32;
@@ -175,18 +173,49 @@ public:
 
         display_.setTextSize(1);
         uint16_t w_type, h_type;
-        display_.getTextBounds(type_name.c_str(), 0, 0, &x1, &y1, &w_type, &h_type);
+        display_.getTextBounds(type_name.data(), 0, 0, &x1, &y1, &w_type, &h_type);
         display_.setCursor((128 - w_type) / 2, 16);
-        display_.println(type_name.c_str());
+        display_.println(type_name.data());
         
         display_.setTextSize(2);
         display_.setCursor(start_x + icon_w + spacing, y_pos + (icon_h - h_val) / 2);
-        display_.println(val_unit.c_str());
+        display_.println(val_unit);
         
         display_.display();
     }
 
 
+    // `category` must fit one line at text size 1: 21 characters.
+    void showAqi(uint16_t aqi, const char* category) {
+        if (!is_setup_ || !is_enabled_) return;
+
+        char value[8];
+        snprintf(value, sizeof(value), "%u", aqi);
+
+        std::lock_guard<std::mutex> lock(i2c_mutex_);
+        display_.clearDisplay();
+        drawStatusBar();
+
+        int16_t x1, y1;
+        uint16_t w, h;
+        display_.setTextSize(1);
+        display_.getTextBounds("AQI (US)", 0, 0, &x1, &y1, &w, &h);
+        display_.setCursor((128 - w) / 2, 16);
+        display_.println("AQI (US)");
+
+        display_.setTextSize(3);
+        display_.getTextBounds(value, 0, 0, &x1, &y1, &w, &h);
+        display_.setCursor((128 - w) / 2, 28);
+        display_.println(value);
+
+        display_.setTextSize(1);
+        display_.getTextBounds(category, 0, 0, &x1, &y1, &w, &h);
+        display_.setCursor(w < 128 ? (128 - w) / 2 : 0, 55);
+        display_.println(category);
+
+        display_.display();
+    }
+
     void showBootStep(const char* message, int frame) {
         if (!is_setup_ || !is_enabled_) return;
 
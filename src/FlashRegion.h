@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Raw NOR flash storage: erasing a sector sets it to 0xFF, writes can only
+// clear bits. Kept abstract so the log on top of it can run against any
+// backing store of the same shape.
+class FlashRegion {
+public:
+    static constexpr size_t sector_size = 4096;
+
+    virtual ~FlashRegion() = default;
+
+    virtual size_t size() const = 0;
+    virtual bool read(size_t offset, void* data, size_t length) = 0;
+    virtual bool write(size_t offset, const void* data, size_t length) = 0;
+    virtual bool eraseSector(size_t offset) = 0;
+};
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "Measurement.h"
+
+// One logged interval: the latest published value of every sensor in it.
+struct HistoryRecord {
+    uint32_t time;
+    uint8_t valid_mask;
+    std::array<float, measurement_type_count> values;
+
+    bool has(MeasurementType type) const {
+        return valid_mask & (1u << static_cast<size_t>(type));
+    }
+
+    float get(MeasurementType type) const {
+        return values[static_cast<size_t>(type)];
+    }
+};
+
+// Gorilla-style block codec for history records (Pelkonen et al., VLDB 2015).
+// A block is an MSB-first bitstream that starts from a clean state, so every
+// block decodes on its own, record by record.
+//
+//   time    32 bits for the first record, then the delta-of-delta against the
+//           previous interval: '0' if unchanged, else a zig-zag value in a
+//           '10' 7 / '110' 9 / '1110' 12 / '1111' 32 bit bucket
+//   mask    '0' if unchanged, else '1' and one bit per MeasurementType
+//   values  per valid slot, the zig-zag delta of its fixed-point value
+//           against the slot's previous value: '0' if unchanged, else a
+//           4 / 8 / 12 / 32 bit bucket with the same prefixes
+//
+// Temperature and humidity are delta coded as fixed point too, see
+// fixedPointScaleOf(). They only carry two decimals, and XOR coding their
+// float bits takes about three times the space, because decimal steps have
+// no exact binary representation.
+namespace history_codec {
+
+using Widths = std::array<uint8_t, 4>;
+
+static constexpr Widths time_widths = { 7, 9, 12, 32 };
+static constexpr Widths value_widths = { 4, 8, 12, 32 };
+
+inline uint32_t zigzag(int32_t value) {
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+inline int32_t unzigzag(uint32_t value) {
+    return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1u);
+}
+
+inline int32_t quantize(MeasurementType type, float value) {
+    return static_cast<int32_t>(std::lround(value * fixedPointScaleOf(type)));
+}
+
+inline float dequantize(MeasurementType type, int32_t value) {
+    return static_cast<float>(value / fixedPointScaleOf(type));
+}
+
+class BitWriter {
+private:
+    uint8_t* data_;
+    size_t capacity_bits_;
+    size_t bit_count_ = 0;
+    bool overflowed_ = false;
+
+public:
+    BitWriter(uint8_t* data, size_t capacity_bytes) : data_(data), capacity_bits_(capacity_bytes * 8) {}
+
+    // Expects the buffer to be zeroed past bitCount(). Writes nothing once the buffer is full.
+    void write(uint32_t value, uint8_t bits) {
+        if (overflowed_ || bit_count_ + bits > capacity_bits_) {
+            overflowed_ = true;
+            return;
+        }
+        for (int bit = bits - 1; bit >= 0; bit--) {
+            if ((value >> bit) & 1u) {
+                data_[bit_count_ >> 3] |= 0x80u >> (bit_count_ & 7);
+            }
+            bit_count_++;
+        }
+    }
+
+    void writeBucketed(uint32_t value, const Widths& widths) {
+        if (value == 0) {
+            write(0, 1);
+            return;
+        }
+        for (size_t i = 0; i < widths.size(); i++) {
+            const bool last = i + 1 == widths.size();
+            if (last || value < (1u << widths[i])) {
+                write(last ? 0xFu : (1u << (i + 2)) - 2, last ? 4 : i + 2);
+                write(value, widths[i]);
+                return;
+            }
+        }
+    }
+
+    // Drops everything written after `bit_count` and zeroes it again.
+    void rewind(size_t bit_count) {
+        for (size_t bit = bit_count; bit < bit_count_; bit++) {
+            data_[bit >> 3] &= ~(0x80u >> (bit & 7));
+        }
+        bit_count_ = bit_count;
+        overflowed_ = false;
+    }
+
+    size_t bitCount() const { return bit_count_; }
+    bool overflowed() const { return overflowed_; }
+};
+
+class BitReader {
+private:
+    const uint8_t* data_ = nullptr;
+    size_t bit_count_ = 0;
+    size_t position_ = 0;
+    bool exhausted_ = false;
+
+public:
+    void reset(const uint8_t* data, size_t bit_count) {
+        data_ = data;
+        bit_count_ = bit_count;
+        position_ = 0;
+        exhausted_ = false;
+    }
+
+    uint32_t read(uint8_t bits) {
+        if (exhausted_ || position_ + bits > bit_count_) {
+            exhausted_ = true;
+            return 0;
+        }
+        uint32_t value = 0;
+        for (uint8_t i = 0; i < bits; i++) {
+            value = (value << 1) | ((data_[position_ >> 3] >> (7 - (position_ & 7))) & 1u);
+            position_++;
+        }
+        return value;
+    }
+
+    uint32_t readBucketed(const Widths& widths) {
+        if (read(1) == 0) return 0;
+        size_t i = 0;
+        while (i + 1 < widths.size() && read(1) == 1) i++;
+        return read(widths[i]);
+    }
+
+    bool exhausted() const { return exhausted_; }
+};
+
+// Prediction state shared by both sides of the codec.
+struct BlockState {
+    uint16_t record_count = 0;
+    uint32_t last_time = 0;
+    int32_t last_delta = 0;
+    uint8_t last_mask = 0;
+    std::array<int32_t, measurement_type_count> last_values{};
+};
+
+} // namespace history_codec
+
+// Appends records to a fixed-size block until it is full.
+class HistoryBlockEncoder {
+private:
+    history_codec::BitWriter writer_;
+    history_codec::BlockState state_;
+
+public:
+    HistoryBlockEncoder(uint8_t* data, size_t capacity_bytes) : writer_(data, capacity_bytes) {}
+
+    // Starts a new block. The buffer must be zeroed.
+    void reset() {
+        writer_.rewind(0);
+        state_ = {};
+    }
+
+    // Returns false, leaving the block unchanged, if the record does not fit.
+    bool append(const HistoryRecord& record) {
+        using namespace history_codec;
+        const size_t start_bit = writer_.bitCount();
+        const BlockState previous = state_;
+
+        if (state_.record_count == 0) {
+            writer_.write(record.time, 32);
+        } else {
+            const int32_t delta = static_cast<int32_t>(record.time - state_.last_time);
+            writer_.writeBucketed(zigzag(delta - state_.last_delta), time_widths);
+            state_.last_delta = delta;
+        }
+        state_.last_time = record.time;
+
+        if (state_.record_count > 0 && record.valid_mask == state_.last_mask) {
+            writer_.write(0, 1);
+        } else {
+            writer_.write(1, 1);
+            writer_.write(record.valid_mask, measurement_type_count);
+        }
+        state_.last_mask = record.valid_mask;
+
+        for (size_t index = 0; index < measurement_type_count; index++) {
+            if (!(record.valid_mask & (1u << index))) continue;
+            const int32_t value = quantize(static_cast<MeasurementType>(index), record.values[index]);
+            const int32_t delta = static_cast<int32_t>(static_cast<uint32_t>(value) - static_cast<uint32_t>(state_.last_values[index]));
+            writer_.writeBucketed(zigzag(delta), value_widths);
+            state_.last_values[index] = value;
+        }
+
+        if (writer_.overflowed()) {
+            writer_.rewind(start_bit);
+            state_ = previous;
+            return false;
+        }
+        state_.record_count++;
+        return true;
+    }
+
+    size_t bitCount() const { return writer_.bitCount(); }
+    uint16_t recordCount() const { return state_.record_count; }
+};
+
+// Streams the records back out of a block.
+class HistoryBlockDecoder {
+private:
+    history_codec::BitReader reader_;
+    history_codec::BlockState state_;
+    uint16_t record_count_ = 0;
+
+public:
+    void reset(const uint8_t* data, size_t bit_count, uint16_t record_count) {
+        reader_.reset(data, bit_count);
+        state_ = {};
+        record_count_ = record_count;
+    }
+
+    // Returns false once all records are read or the block turns out to be malformed.
+    bool next(HistoryRecord& record) {
+        using namespace history_codec;
+        if (state_.record_count >= record_count_ || reader_.exhausted()) return false;
+
+        if (state_.record_count == 0) {
+            record.time = reader_.read(32);
+        } else {
+            state_.last_delta += unzigzag(reader_.readBucketed(time_widths));
+            record.time = state_.last_time + state_.last_delta;
+        }
+        state_.last_time = record.time;
+
+        if (reader_.read(1) == 1) {
+            state_.last_mask = reader_.read(measurement_type_count);
+        }
+        record.valid_mask = state_.last_mask;
+
+        for (size_t index = 0; index < measurement_type_count; index++) {
+            if (!(record.valid_mask & (1u << index))) {
+                record.values[index] = 0;
+                continue;
+            }
+            state_.last_values[index] = static_cast<int32_t>(
+                static_cast<uint32_t>(state_.last_values[index]) + static_cast<uint32_t>(unzigzag(reader_.readBucketed(value_widths))));
+            record.values[index] = dequantize(static_cast<MeasurementType>(index), state_.last_values[index]);
+        }
+
+        if (reader_.exhausted()) return false;
+        state_.record_count++;
+        return true;
+    }
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "HistoryLog.h"
+#include "Translator.h"
+
+// Turns history log records into CSV or NDJSON text on demand. The output
+// is produced one line at a time into whatever buffer the caller hands in,
+// so memory use is the same for one record or a month of them.
+class HistoryExport {
+public:
+    enum class Format { Csv, NdJson };
+
+private:
+    HistoryLog::Reader reader_;
+    const Format format_;
+    bool header_pending_;
+    std::array<char, 160> line_{};
+    size_t line_length_ = 0;
+    size_t line_offset_ = 0;
+
+    static int formatValue(char* buffer, size_t size, MeasurementType type, float value) {
+        return isRoundNumber(type)
+            ? snprintf(buffer, size, "%ld", static_cast<long>(value))
+            : snprintf(buffer, size, "%.2f", value);
+    }
+
+    size_t formatHeader() {
+        size_t length = snprintf(line_.data(), line_.size(), "time");
+        for (size_t index = 0; index < measurement_type_count; index++) {
+            const std::string_view name = ApiNameTypeTranslator().translate(static_cast<MeasurementType>(index));
+            length += snprintf(line_.data() + length, line_.size() - length, ",%.*s", static_cast<int>(name.size()), name.data());
+        }
+        length += snprintf(line_.data() + length, line_.size() - length, "\n");
+        return std::min(length, line_.size() - 1);
+    }
+
+    size_t formatRecord(const HistoryRecord& record) {
+        char* line = line_.data();
+        const size_t size = line_.size();
+        size_t length = format_ == Format::Csv
+            ? snprintf(line, size, "%u", record.time)
+            : snprintf(line, size, "{\"time\":%u", record.time);
+
+        for (size_t index = 0; index < measurement_type_count && length < size; index++) {
+            const MeasurementType type = static_cast<MeasurementType>(index);
+            if (format_ == Format::Csv) {
+                length += snprintf(line + length, size - length, ",");
+                if (record.has(type) && length < size) {
+                    length += formatValue(line + length, size - length, type, record.get(type));
+                }
+            } else if (record.has(type)) {
+                const std::string_view name = ApiNameTypeTranslator().translate(type);
+                length += snprintf(line + length, size - length, ",\"%.*s\":", static_cast<int>(name.size()), name.data());
+                if (length < size) {
+                    length += formatValue(line + length, size - length, type, record.get(type));
+                }
+            }
+        }
+
+        if (length < size) {
+            length += snprintf(line + length, size - length, format_ == Format::Csv ? "\n" : "}\n");
+        }
+        return std::min(length, size - 1);
+    }
+
+    bool nextLine() {
+        line_offset_ = 0;
+        if (header_pending_) {
+            header_pending_ = false;
+            line_length_ = formatHeader();
+            return true;
+        }
+
+        HistoryRecord record;
+        if (!reader_.next(record)) {
+            line_length_ = 0;
+            return false;
+        }
+        line_length_ = formatRecord(record);
+        return true;
+    }
+
+public:
+    HistoryExport(HistoryLog::Reader reader, Format format)
+        : reader_(reader)
+        , format_(format)
+        , header_pending_(format == Format::Csv) {
+    }
+
+    // Writes up to `size` bytes of output into `buffer`. Returns 0 once everything was written.
+    size_t fill(uint8_t* buffer, size_t size) {
+        size_t written = 0;
+        while (written < size) {
+            if (line_offset_ == line_length_ && !nextLine()) break;
+
+            const size_t n = std::min(size - written, line_length_ - line_offset_);
+            memcpy(buffer + written, line_.data() + line_offset_, n);
+            line_offset_ += n;
+            written += n;
+        }
+        return written;
+    }
+};
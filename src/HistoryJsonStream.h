@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+
+#include "HistoryStore.h"
+#include "Translator.h"
+
+// Turns HistoryStore points into the /api/history JSON on demand. Points are
+// copied out of the store a batch at a time, so the store lock is only held
+// per batch and not while the response is being sent, and output is produced
+// one point at a time into whatever buffer the caller hands in.
+class HistoryJsonStream {
+public:
+    static constexpr size_t batch_capacity = 32;
+
+private:
+    enum class Stage { Header, Points, Footer, Done };
+
+    const HistoryStore& store_;
+    const MeasurementType type_;
+    const HistoryResolution resolution_;
+    const char* const resolution_name_;
+    uint32_t next_from_;
+    std::optional<HistoryDownsampler> downsampler_;
+
+    std::array<HistoryPoint, batch_capacity> batch_{};
+    size_t batch_size_ = 0;
+    size_t batch_index_ = 0;
+    bool source_done_ = false;
+
+    HistoryPoint pending_{};
+    bool has_pending_ = false;
+
+    Stage stage_ = Stage::Header;
+    bool first_point_ = true;
+    std::array<char, 96> line_{};
+    size_t line_length_ = 0;
+    size_t line_offset_ = 0;
+
+    bool nextSourcePoint(HistoryPoint& point) {
+        if (batch_index_ == batch_size_) {
+            if (source_done_) return false;
+            batch_size_ = store_.read(type_, resolution_, next_from_, batch_.data(), batch_.size());
+            batch_index_ = 0;
+            if (batch_size_ == 0) {
+                source_done_ = true;
+                return false;
+            }
+            next_from_ = batch_[batch_size_ - 1].time + 1;
+        }
+        point = batch_[batch_index_++];
+        return true;
+    }
+
+    bool nextPoint(HistoryPoint& point) {
+        auto keep = [this](const HistoryPoint& downsampled) {
+            pending_ = downsampled;
+            has_pending_ = true;
+        };
+
+        while (!has_pending_) {
+            HistoryPoint source;
+            if (!nextSourcePoint(source)) {
+                if (!downsampler_) return false;
+                downsampler_->finish(keep);
+                downsampler_.reset();
+                continue;
+            }
+            if (!downsampler_) {
+                point = source;
+                return true;
+            }
+            downsampler_->add(source, keep);
+        }
+
+        has_pending_ = false;
+        point = pending_;
+        return true;
+    }
+
+    size_t clamp(int length) const {
+        return length < 0 ? 0 : std::min(static_cast<size_t>(length), line_.size() - 1);
+    }
+
+    bool nextLine() {
+        line_offset_ = 0;
+        line_length_ = 0;
+        HistoryPoint point;
+        switch (stage_) {
+            case Stage::Header: {
+                const std::string_view name = ApiNameTypeTranslator().translate(type_);
+                line_length_ = clamp(snprintf(line_.data(), line_.size(), "{\"type\":\"%.*s\",\"res\":\"%s\",\"points\":[",
+                                              static_cast<int>(name.size()), name.data(), resolution_name_));
+                stage_ = Stage::Points;
+                return true;
+            }
+            case Stage::Points:
+                if (nextPoint(point)) {
+                    line_length_ = clamp(snprintf(line_.data(), line_.size(), "%s[%u,%.2f,%.2f,%.2f,%u]",
+                                                  first_point_ ? "" : ",", static_cast<unsigned>(point.time),
+                                                  point.min, point.max, point.mean, static_cast<unsigned>(point.count)));
+                    first_point_ = false;
+                    return true;
+                }
+                stage_ = Stage::Footer;
+                [[fallthrough]];
+            case Stage::Footer:
+                line_length_ = clamp(snprintf(line_.data(), line_.size(), "]}"));
+                stage_ = Stage::Done;
+                return true;
+            case Stage::Done:
+                break;
+        }
+        return false;
+    }
+
+public:
+    // With `points` > 0 the series is downsampled to at most that many points, see HistoryDownsampler.
+    HistoryJsonStream(const HistoryStore& store, MeasurementType type, HistoryResolution resolution,
+                      const char* resolution_name, uint32_t from, uint32_t points)
+        : store_(store)
+        , type_(type)
+        , resolution_(resolution)
+        , resolution_name_(resolution_name)
+        , next_from_(from) {
+        uint32_t oldest = 0;
+        uint32_t newest = 0;
+        if (points == 0) return;
+        if (store_.span(resolution_, oldest, newest)) {
+            downsampler_.emplace(std::max(from, oldest), newest, points);
+        } else {
+            source_done_ = true;
+        }
+    }
+
+    // Writes up to `size` bytes of output into `buffer`. Returns 0 once everything was written.
+    size_t fill(uint8_t* buffer, size_t size) {
+        size_t written = 0;
+        while (written < size) {
+            if (line_offset_ == line_length_ && !nextLine()) break;
+
+            const size_t n = std::min(size - written, line_length_ - line_offset_);
+            memcpy(buffer + written, line_.data() + line_offset_, n);
+            line_offset_ += n;
+            written += n;
+        }
+        return written;
+    }
+};
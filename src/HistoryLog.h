@@ -0,0 +1,360 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+
+#include "FlashRegion.h"
+#include "HistoryCodec.h"
+#include "Logger.h"
+#include "Measurement.h"
+#include "WallClock.h"
+
+// Append-only log of sample frames in a raw flash region, so readings
+// survive reboots.
+//
+// The region is used as a ring of 256-byte pages, each carrying a sequence
+// number and a CRC over its contents, followed by a block of records
+// compressed with HistoryBlockEncoder. The write head only moves forward and
+// erases a sector right before entering it, so every sector is erased once
+// per lap (wear is spread evenly) and the oldest data is what gets recycled.
+// After a reset the valid page with the highest sequence number marks the
+// head; pages torn by a power loss fail their CRC and are skipped.
+//
+// append() only touches RAM. Completed pages are written by flush(), which
+// runs on a low-priority task so flash I/O stays off the sensor task.
+class HistoryLog {
+public:
+    // Frames published within the same interval are merged into one record stamped with its start.
+    static constexpr uint32_t record_interval_seconds = 60;
+    static constexpr size_t page_size = 256;
+
+    using Record = HistoryRecord;
+
+    struct Stats {
+        uint32_t pages_written;
+        uint32_t write_errors;
+        uint32_t dropped_pages;
+        uint32_t next_sequence;
+        size_t head_page;
+        size_t page_count;
+    };
+
+private:
+    static constexpr uint32_t page_magic = 0x32474C48; // "HLG2"
+
+    struct PageHeader {
+        uint32_t magic;
+        uint32_t sequence;
+        uint16_t record_count;
+        uint16_t bit_count;
+        uint32_t crc; // covers the header fields above and the used part of the body
+    };
+
+    struct Page {
+        PageHeader header;
+        std::array<uint8_t, page_size - sizeof(PageHeader)> body;
+    };
+    static_assert(sizeof(Page) == page_size, "Page does not fit");
+
+    FlashRegion& region_;
+
+    // Flash side, guarded by flash_mutex_.
+    std::mutex flash_mutex_;
+    size_t page_count_ = 0;
+    size_t head_page_ = 0;
+    uint32_t next_sequence_ = 1;
+    std::atomic<bool> ready_{false};
+
+    // RAM side, guarded by mutex_. Lock order is flash_mutex_ before mutex_.
+    std::mutex mutex_;
+    Record open_{};
+    bool has_open_ = false;
+    Page filling_{};
+    HistoryBlockEncoder encoder_{ filling_.body.data(), filling_.body.size() };
+    Page sealed_{};
+    bool has_sealed_ = false;
+
+    std::atomic<uint32_t> pages_written_{0};
+    std::atomic<uint32_t> write_errors_{0};
+    std::atomic<uint32_t> dropped_pages_{0};
+
+    static uint32_t crc32(const void* data, size_t length, uint32_t crc = 0) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        crc = ~crc;
+        while (length--) {
+            crc ^= *bytes++;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+            }
+        }
+        return ~crc;
+    }
+
+    static uint32_t checksumOf(const Page& page) {
+        const uint32_t crc = crc32(&page.header, offsetof(PageHeader, crc));
+        return crc32(page.body.data(), (page.header.bit_count + 7) / 8, crc);
+    }
+
+    static bool isValid(const Page& page) {
+        return page.header.magic == page_magic
+            && page.header.record_count > 0
+            && page.header.bit_count <= page.body.size() * 8
+            && page.header.crc == checksumOf(page);
+    }
+
+    static bool isBlank(const Page& page) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&page);
+        for (size_t i = 0; i < sizeof(Page); i++) {
+            if (bytes[i] != 0xFF) return false;
+        }
+        return true;
+    }
+
+    bool readPage(size_t index, Page& page) {
+        return region_.read(index * page_size, &page, sizeof(Page));
+    }
+
+    // Expects flash_mutex_ to be held.
+    bool writePage(Page& page) {
+        for (size_t attempt = 0; attempt < page_count_; attempt++) {
+            const size_t index = head_page_;
+            const size_t offset = index * page_size;
+            head_page_ = (head_page_ + 1) % page_count_;
+
+            if (offset % FlashRegion::sector_size == 0) {
+                if (!region_.eraseSector(offset)) return false;
+            } else {
+                // A page left half-written by a power loss can't be programmed again until its sector is erased.
+                Page existing;
+                if (!readPage(index, existing) || !isBlank(existing)) continue;
+            }
+
+            page.header.magic = page_magic;
+            page.header.sequence = next_sequence_++;
+            page.header.crc = checksumOf(page);
+            return region_.write(offset, &page, sizeof(Page));
+        }
+        return false;
+    }
+
+    // Expects mutex_ to be held.
+    void sealFilling() {
+        if (encoder_.recordCount() == 0) return;
+        if (has_sealed_) dropped_pages_++;
+        filling_.header.record_count = encoder_.recordCount();
+        filling_.header.bit_count = encoder_.bitCount();
+        sealed_ = filling_;
+        has_sealed_ = true;
+        filling_.body.fill(0);
+        encoder_.reset();
+    }
+
+    // Expects mutex_ to be held.
+    void closeOpenRecord() {
+        if (!has_open_) return;
+        has_open_ = false;
+        if (!encoder_.append(open_)) {
+            sealFilling();
+            encoder_.append(open_);
+        }
+    }
+
+public:
+    // Streams every stored record at or after a given time, oldest first.
+    // The set of records is fixed when the reader is created: pages written
+    // later are not included, pages recycled in the meantime are skipped.
+    class Reader {
+        friend class HistoryLog;
+
+    private:
+        HistoryLog& log_;
+        const uint32_t from_;
+        uint32_t end_sequence_ = 0;
+        uint32_t last_sequence_ = 0;
+        size_t next_page_ = 0;
+        size_t pages_left_ = 0;
+        Page page_{};
+        HistoryBlockDecoder decoder_;
+
+        // What was still in RAM when the reader was created.
+        std::array<Page, 2> tail_pages_{};
+        size_t tail_page_count_ = 0;
+        size_t tail_page_index_ = 0;
+        Record open_{};
+        bool has_open_ = false;
+
+        Reader(HistoryLog& log, uint32_t from) : log_(log), from_(from) {}
+
+        // Moves on to the next flash page, then to the RAM pages. Returns false when none are left.
+        bool loadNextPage() {
+            if (pages_left_ > 0) {
+                std::lock_guard<std::mutex> lock(log_.flash_mutex_);
+                const bool loaded = log_.readPage(next_page_, page_) && isValid(page_)
+                    && page_.header.sequence > last_sequence_
+                    && page_.header.sequence < end_sequence_;
+                next_page_ = (next_page_ + 1) % log_.page_count_;
+                pages_left_--;
+
+                if (loaded) {
+                    last_sequence_ = page_.header.sequence;
+                } else {
+                    page_.header.record_count = 0;
+                }
+            } else if (tail_page_index_ < tail_page_count_) {
+                page_ = tail_pages_[tail_page_index_++];
+            } else {
+                return false;
+            }
+
+            decoder_.reset(page_.body.data(), page_.header.bit_count, page_.header.record_count);
+            return true;
+        }
+
+    public:
+        bool next(Record& record) {
+            do {
+                while (decoder_.next(record)) {
+                    if (record.time >= from_) return true;
+                }
+            } while (loadNextPage());
+
+            if (has_open_) {
+                has_open_ = false;
+                if (open_.time >= from_) {
+                    record = open_;
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    explicit HistoryLog(FlashRegion& region) : region_(region) {}
+
+    // Scans the region for the newest valid page and resumes writing after it.
+    bool begin() {
+        std::lock_guard<std::mutex> lock(flash_mutex_);
+        page_count_ = region_.size() / FlashRegion::sector_size * FlashRegion::sector_size / page_size;
+        if (page_count_ == 0) return false;
+
+        bool found = false;
+        uint32_t newest_sequence = 0;
+        size_t newest_page = 0;
+        size_t valid_pages = 0;
+
+        Page page;
+        for (size_t index = 0; index < page_count_; index++) {
+            if (!readPage(index, page) || !isValid(page)) continue;
+            valid_pages++;
+            if (!found || page.header.sequence > newest_sequence) {
+                found = true;
+                newest_sequence = page.header.sequence;
+                newest_page = index;
+            }
+        }
+
+        head_page_ = found ? (newest_page + 1) % page_count_ : 0;
+        next_sequence_ = found ? newest_sequence + 1 : 1;
+        ready_.store(true);
+
+        logger.log(Logger::Level::Info, "History log: %u of %u pages valid, resuming at page %u",
+                   valid_pages, page_count_, head_page_);
+        return true;
+    }
+
+    // Adds the published values to the current record. Never touches flash.
+    void append(const SampleFrame& frame, uint32_t time) {
+        if (!ready_.load() || frame.empty() || time < min_valid_time) return;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (has_open_ && time / record_interval_seconds != open_.time / record_interval_seconds) {
+            closeOpenRecord();
+        }
+        if (!has_open_) {
+            open_ = Record{};
+            open_.time = time - time % record_interval_seconds;
+            has_open_ = true;
+        }
+
+        for (size_t index = 0; index < measurement_type_count; index++) {
+            if (frame.valid_mask & (1u << index)) {
+                open_.values[index] = static_cast<float>(frame.values[index]);
+            }
+        }
+        open_.valid_mask |= frame.valid_mask;
+    }
+
+    // Writes the completed page, if there is one.
+    void flush() {
+        std::lock_guard<std::mutex> flash_lock(flash_mutex_);
+        if (!ready_.load()) return;
+
+        Page page;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!has_sealed_) return;
+            page = sealed_;
+            has_sealed_ = false;
+        }
+
+        if (writePage(page)) {
+            pages_written_++;
+            return;
+        }
+
+        // Keep the page for the next flush; writePage() moves on to a fresh page each attempt.
+        write_errors_++;
+        logger.log(Logger::Level::Error, "History log: writing a page failed");
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (has_sealed_) {
+            dropped_pages_++;
+        } else {
+            sealed_ = page;
+            has_sealed_ = true;
+        }
+    }
+
+    // Writes everything still held in RAM, even a partial page. Used before a planned restart.
+    void sync() {
+        flush();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closeOpenRecord();
+            sealFilling();
+        }
+        flush();
+    }
+
+    Reader read(uint32_t from) {
+        Reader reader(*this, from);
+        std::lock_guard<std::mutex> flash_lock(flash_mutex_);
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        reader.end_sequence_ = next_sequence_;
+        reader.next_page_ = head_page_;
+        reader.pages_left_ = ready_.load() ? page_count_ : 0;
+
+        if (has_sealed_) {
+            reader.tail_pages_[reader.tail_page_count_++] = sealed_;
+        }
+        if (encoder_.recordCount() > 0) {
+            Page& page = reader.tail_pages_[reader.tail_page_count_++];
+            page = filling_;
+            page.header.record_count = encoder_.recordCount();
+            page.header.bit_count = encoder_.bitCount();
+        }
+        reader.open_ = open_;
+        reader.has_open_ = has_open_;
+        return reader;
+    }
+
+    Stats getStats() {
+        std::lock_guard<std::mutex> lock(flash_mutex_);
+        return Stats{ pages_written_.load(), write_errors_.load(), dropped_pages_.load(),
+                      next_sequence_, head_page_, page_count_ };
+    }
+};
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "Measurement.h"
+#include "WallClock.h"
+
+enum class HistoryResolution { Raw, OneMinute, FifteenMinutes };
+
+struct HistoryPoint {
+    uint32_t time;
+    double min;
+    double max;
+    double mean;
+    uint16_t count;
+};
+
+// Fixed-memory in-RAM history of published samples.
+//
+// Memory budget (all statically allocated, see history_memory_budget):
+//   raw samples      512 x  8 B =  4.0 KiB  (>1 h at the default sensor cadence)
+//   1-minute tier    240 x 52 B = 12.2 KiB  (4 h, a full day would need 73 KiB)
+//   15-minute tier    96 x 52 B =  4.9 KiB  (24 h)
+// Rollups are updated incrementally as samples arrive; the bucket that is
+// still open is included in queries. Samples from before SNTP synced are
+// dropped, see min_valid_time.
+class HistoryStore {
+public:
+    static constexpr size_t raw_capacity = 512;
+    static constexpr size_t minute_capacity = 240;
+    static constexpr size_t quarter_hour_capacity = 96;
+
+private:
+    struct RawSample {
+        uint32_t time;
+        int16_t value;
+        uint8_t type;
+        uint8_t reserved;
+    };
+
+    struct RollupValue {
+        int16_t min;
+        int16_t max;
+        int16_t mean;
+        uint16_t count;
+    };
+
+    struct RollupBucket {
+        uint32_t start_time;
+        std::array<RollupValue, measurement_type_count> values;
+    };
+
+    struct OpenRollup {
+        float min;
+        float max;
+        float sum;
+        uint16_t count;
+    };
+
+    template <size_t Capacity>
+    struct RollupTier {
+        const uint32_t bucket_seconds;
+        std::array<RollupBucket, Capacity> buckets{};
+        size_t head = 0;
+        size_t size = 0;
+
+        uint32_t open_start_time = 0;
+        std::array<OpenRollup, measurement_type_count> open{};
+
+        explicit RollupTier(uint32_t bucket_seconds) : bucket_seconds(bucket_seconds) {}
+
+        static RollupValue close(MeasurementType type, const OpenRollup& open) {
+            if (open.count == 0) return RollupValue{ 0, 0, 0, 0 };
+            return RollupValue{ encode(type, open.min), encode(type, open.max),
+                                encode(type, open.sum / open.count), open.count };
+        }
+
+        bool hasOpenValues() const {
+            for (const OpenRollup& value : open) {
+                if (value.count > 0) return true;
+            }
+            return false;
+        }
+
+        void add(MeasurementType type, double value, uint32_t time) {
+            const uint32_t start_time = time - time % bucket_seconds;
+            if (start_time != open_start_time) {
+                if (hasOpenValues()) {
+                    RollupBucket& bucket = buckets[head];
+                    bucket.start_time = open_start_time;
+                    for (size_t i = 0; i < measurement_type_count; i++) {
+                        bucket.values[i] = close(static_cast<MeasurementType>(i), open[i]);
+                    }
+                    head = (head + 1) % Capacity;
+                    if (size < Capacity) size++;
+                }
+                open_start_time = start_time;
+                open = {};
+            }
+
+            OpenRollup& slot = open[static_cast<size_t>(type)];
+            const float v = static_cast<float>(value);
+            if (slot.count == 0 || v < slot.min) slot.min = v;
+            if (slot.count == 0 || v > slot.max) slot.max = v;
+            slot.sum += v;
+            if (slot.count < UINT16_MAX) slot.count++;
+        }
+
+        bool span(uint32_t& first, uint32_t& last) const {
+            const bool open_values = hasOpenValues();
+            if (size == 0 && !open_values) return false;
+            first = size > 0 ? buckets[(head + Capacity - size) % Capacity].start_time : open_start_time;
+            last = open_values ? open_start_time : buckets[(head + Capacity - 1) % Capacity].start_time;
+            return true;
+        }
+
+        template <typename Fn>
+        void forEach(MeasurementType type, uint32_t from, Fn& fn) const {
+            const size_t index = static_cast<size_t>(type);
+            for (size_t i = 0; i < size; i++) {
+                const RollupBucket& bucket = buckets[(head + Capacity - size + i) % Capacity];
+                const RollupValue& value = bucket.values[index];
+                if (value.count == 0 || bucket.start_time < from) continue;
+                fn(HistoryPoint{ bucket.start_time, decode(type, value.min), decode(type, value.max),
+                                 decode(type, value.mean), value.count });
+            }
+
+            const OpenRollup& value = open[index];
+            if (value.count > 0 && open_start_time >= from) {
+                fn(HistoryPoint{ open_start_time, value.min, value.max, value.sum / value.count, value.count });
+            }
+        }
+    };
+
+    std::array<RawSample, raw_capacity> raw_{};
+    size_t raw_head_ = 0;
+    size_t raw_size_ = 0;
+
+    RollupTier<minute_capacity> minutes_{ 60 };
+    RollupTier<quarter_hour_capacity> quarter_hours_{ 15 * 60 };
+
+    mutable std::mutex mutex_;
+
+    // Values are stored as 16-bit fixed point, see fixedPointScaleOf().
+    static int16_t encode(MeasurementType type, double value) {
+        double scaled = value * fixedPointScaleOf(type);
+        if (scaled > INT16_MAX) scaled = INT16_MAX;
+        if (scaled < INT16_MIN) scaled = INT16_MIN;
+        return static_cast<int16_t>(scaled < 0 ? scaled - 0.5 : scaled + 0.5);
+    }
+
+    static double decode(MeasurementType type, int16_t value) {
+        return value / fixedPointScaleOf(type);
+    }
+
+public:
+    void add(const SampleFrame& frame, uint32_t time) {
+        if (time < min_valid_time) return;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t index = 0; index < measurement_type_count; index++) {
+            const MeasurementType type = static_cast<MeasurementType>(index);
+            if (!frame.has(type)) continue;
+
+            const double value = frame.get(type);
+            raw_[raw_head_] = RawSample{ time, encode(type, value), static_cast<uint8_t>(index), 0 };
+            raw_head_ = (raw_head_ + 1) % raw_capacity;
+            if (raw_size_ < raw_capacity) raw_size_++;
+
+            minutes_.add(type, value, time);
+            quarter_hours_.add(type, value, time);
+        }
+    }
+
+    // Oldest and newest time held at a resolution, across all types. Returns false if there is none.
+    bool span(HistoryResolution resolution, uint32_t& first, uint32_t& last) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        switch (resolution) {
+            case HistoryResolution::Raw:
+                if (raw_size_ == 0) return false;
+                first = raw_[(raw_head_ + raw_capacity - raw_size_) % raw_capacity].time;
+                last = raw_[(raw_head_ + raw_capacity - 1) % raw_capacity].time;
+                return true;
+            case HistoryResolution::OneMinute:
+                return minutes_.span(first, last);
+            case HistoryResolution::FifteenMinutes:
+                return quarter_hours_.span(first, last);
+        }
+        return false;
+    }
+
+    // Calls `fn(const HistoryPoint&)` for every point of `type` at or after `from`, oldest first.
+    // Raw samples are reported as points with min == max == mean and a count of 1.
+    template <typename Fn>
+    void forEach(MeasurementType type, HistoryResolution resolution, uint32_t from, Fn&& fn) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        switch (resolution) {
+            case HistoryResolution::Raw:
+                for (size_t i = 0; i < raw_size_; i++) {
+                    const RawSample& sample = raw_[(raw_head_ + raw_capacity - raw_size_ + i) % raw_capacity];
+                    if (sample.type != static_cast<uint8_t>(type) || sample.time < from) continue;
+                    const double value = decode(type, sample.value);
+                    fn(HistoryPoint{ sample.time, value, value, value, 1 });
+                }
+                break;
+            case HistoryResolution::OneMinute:
+                minutes_.forEach(type, from, fn);
+                break;
+            case HistoryResolution::FifteenMinutes:
+                quarter_hours_.forEach(type, from, fn);
+                break;
+        }
+    }
+
+    // Copies up to `max_points` points of `type` at or after `from` into `points`, oldest first,
+    // holding the lock once. Returns how many were copied; continue from the last time + 1.
+    size_t read(MeasurementType type, HistoryResolution resolution, uint32_t from,
+                HistoryPoint* points, size_t max_points) const {
+        size_t count = 0;
+        forEach(type, resolution, from, [&](const HistoryPoint& point) {
+            if (count < max_points) points[count++] = point;
+        });
+        return count;
+    }
+};
+
+// Folds a time-ordered stream of points into at most `points` equal-width
+// time buckets over [from, to]. Every bucket keeps the min of the mins, the
+// max of the maxes and the count-weighted mean, so short peaks survive the
+// downsampling. One pass, constant memory, output bounded by `points`.
+class HistoryDownsampler {
+private:
+    const uint32_t from_;
+    const uint64_t span_;
+    const uint32_t points_;
+
+    bool open_ = false;
+    uint32_t bucket_ = 0;
+    HistoryPoint point_{};
+    double sum_ = 0;
+    uint32_t count_ = 0;
+
+    template <typename Fn>
+    void emit(Fn& fn) {
+        point_.time = from_ + static_cast<uint32_t>(bucket_ * span_ / points_);
+        point_.mean = sum_ / count_;
+        point_.count = count_ < UINT16_MAX ? count_ : UINT16_MAX;
+        fn(point_);
+    }
+
+public:
+    HistoryDownsampler(uint32_t from, uint32_t to, uint32_t points)
+        : from_(from)
+        , span_(to >= from ? static_cast<uint64_t>(to - from) + 1 : 1)
+        , points_(points > 0 ? points : 1) {
+    }
+
+    template <typename Fn>
+    void add(const HistoryPoint& point, Fn& fn) {
+        if (point.time < from_) return;
+        const uint64_t offset = point.time - from_;
+        const uint32_t bucket = offset >= span_ ? points_ - 1 : static_cast<uint32_t>(offset * points_ / span_);
+
+        if (open_ && bucket != bucket_) {
+            emit(fn);
+            open_ = false;
+        }
+        if (!open_) {
+            open_ = true;
+            bucket_ = bucket;
+            point_ = point;
+            sum_ = 0;
+            count_ = 0;
+        }
+
+        if (point.min < point_.min) point_.min = point.min;
+        if (point.max > point_.max) point_.max = point.max;
+        sum_ += point.mean * point.count;
+        count_ += point.count;
+    }
+
+    template <typename Fn>
+    void finish(Fn& fn) {
+        if (open_) emit(fn);
+        open_ = false;
+    }
+};
+
+static constexpr size_t history_memory_budget = 22 * 1024;
+static_assert(sizeof(HistoryStore) <= history_memory_budget, "HistoryStore exceeds its RAM budget");
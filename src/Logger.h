@@ -1,7 +1,8 @@
 #pragma once
 
 #include <memory>
-#include <format>
+#include <string>
+#include <string_view>
 #include <unordered_map>
 #include <mutex>
 
@@ -1,50 +1,172 @@
-#pragma once 
+#pragma once
 
-#include "MHZ19.h"
-#include "SoftwareSerial.h"
+#include <array>
+#include <atomic>
+#include <HardwareSerial.h>
 
 #include "Sensor.h"
+#include "SpscRing.h"
 #include "Logger.h"
 
+// MH-Z19 on a hardware UART. The 0x86 "read CO2" request is sent without
+// waiting; the 9-byte reply is collected by the UART receive callback into a
+// ring and picked up on a later scheduler tick, so the sensor task never
+// blocks on the serial line.
 class MHZ19Wrapper : public SensorDriver {
 
+public:
+    struct Stats {
+        uint32_t requests;
+        uint32_t timeouts;
+        uint32_t checksum_errors;
+        uint32_t last_latency_micros;
+        uint32_t max_latency_micros;
+    };
+
+    static constexpr const char* name = "MHZ19";
+    static constexpr std::array<SensorEntity, 1> entities = {{
+        { MeasurementType::CO2, "co2", "CO2", "carbon_dioxide", "ppm" }
+    }};
+
 private:
-    const MeasurementDetails sensor_details = MeasurementDetails(MeasurementType::CO2, MeasurementUnit::PPM);
+    static constexpr size_t frame_length = 9;
+    static constexpr uint8_t start_byte = 0xFF;
+    static constexpr uint8_t command_read_co2 = 0x86;
+    static constexpr uint8_t command_auto_calibration = 0x79;
+    static constexpr uint32_t reply_timeout_millis = 500;
 
-    MHZ19 sensor;
-    SoftwareSerial serial;
+    HardwareSerial& serial;
+    const int8_t rx_pin;
+    const int8_t tx_pin;
     const uint32_t baud_rate;
     uint32_t warmup_start_millis = 0;
     const uint32_t warmup_duration_millis = 120000; // 2 minutes
 
+    SpscRing<64> rx_ring;
+    bool request_pending = false;
+    uint32_t request_start_millis = 0;
+    uint32_t request_start_micros = 0;
+    std::atomic<uint32_t> last_rx_micros{0};
+
+    std::atomic<uint32_t> requests{0};
+    std::atomic<uint32_t> timeouts{0};
+    std::atomic<uint32_t> checksum_errors{0};
+    std::atomic<uint32_t> last_latency_micros{0};
+    std::atomic<uint32_t> max_latency_micros{0};
+
+    static uint8_t checksum(const uint8_t* frame) {
+        uint8_t sum = 0;
+        for (size_t i = 1; i < frame_length - 1; i++) {
+            sum += frame[i];
+        }
+        return static_cast<uint8_t>(0xFF - sum + 1);
+    }
+
+    void sendCommand(uint8_t command, uint8_t argument = 0) {
+        uint8_t frame[frame_length] = { start_byte, 0x01, command, argument, 0, 0, 0, 0, 0 };
+        frame[frame_length - 1] = checksum(frame);
+        serial.write(frame, frame_length);
+    }
+
+    // Runs on the UART event task.
+    void receive() {
+        rx_ring.fill([this](uint8_t* dest, size_t max) {
+            return serial.read(dest, std::min<size_t>(max, serial.available()));
+        });
+        last_rx_micros.store(micros());
+    }
+
+    // Looks for a complete reply to the read request in the ring.
+    bool takeReply(uint32_t& co2) {
+        while (rx_ring.size() >= frame_length) {
+            if (rx_ring.peek(0) != start_byte || rx_ring.peek(1) != command_read_co2) {
+                rx_ring.discard(1);
+                continue;
+            }
+
+            uint8_t sum = 0;
+            for (size_t i = 1; i < frame_length - 1; i++) {
+                sum += rx_ring.peek(i);
+            }
+            if (static_cast<uint8_t>(0xFF - sum + 1) != rx_ring.peek(frame_length - 1)) {
+                checksum_errors++;
+                rx_ring.discard(1);
+                continue;
+            }
+
+            co2 = static_cast<uint32_t>(rx_ring.peek(2)) << 8 | rx_ring.peek(3);
+            rx_ring.discard(frame_length);
+            return true;
+        }
+        return false;
+    }
+
 public:
-    MHZ19Wrapper(int8_t rx_pin, int8_t tx_pin, uint32_t baud_rate) 
-        : serial(tx_pin, rx_pin)
+    MHZ19Wrapper(HardwareSerial& serial, int8_t rx_pin, int8_t tx_pin, uint32_t baud_rate) 
+        : serial(serial)
+        , rx_pin(rx_pin)
+        , tx_pin(tx_pin)
         , baud_rate(baud_rate) {
     }
 
-    bool begin() override {
-        serial.begin(baud_rate);
-        sensor.begin(serial);
-        sensor.autoCalibration(true);
+    bool begin() {
+        serial.begin(baud_rate, SERIAL_8N1, rx_pin, tx_pin);
+        serial.onReceive([this]() { receive(); });
+        sendCommand(command_auto_calibration, 0xA0);
         warmup_start_millis = millis();
 
         return true;
     }
 
-    bool provideMeasurements(std::vector<std::unique_ptr<Measurement>>& measurements) override {
-        if (millis() - warmup_start_millis < warmup_duration_millis) {
-            return false;
+    ReadStatus read(uint32_t now, SampleFrame& frame) {
+        if (now - warmup_start_millis < warmup_duration_millis) {
+            return ReadStatus::Failed;
+        }
+
+        if (!request_pending) {
+            rx_ring.clear();
+            request_pending = true;
+            request_start_millis = now;
+            request_start_micros = micros();
+            requests++;
+            sendCommand(command_read_co2);
+            return ReadStatus::Pending;
         }
 
-        const uint32_t value = sensor.getCO2(false);
+        uint32_t value = 0;
+        if (!takeReply(value)) {
+            if (now - request_start_millis < reply_timeout_millis) {
+                return ReadStatus::Pending;
+            }
+            request_pending = false;
+            timeouts++;
+            logger.log(Logger::Level::Warning, "Reading CO2 concentration failed: no reply within %ums", reply_timeout_millis);
+            return ReadStatus::Failed;
+        }
+
+        request_pending = false;
+        const uint32_t latency = last_rx_micros.load() - request_start_micros;
+        last_latency_micros.store(latency);
+        if (latency > max_latency_micros.load()) {
+            max_latency_micros.store(latency);
+        }
   
         if (value > 0) {
-            measurements.push_back(std::make_unique<RoundNumberMeasurement>(sensor_details, value));
-            return true;
+            frame.set(MeasurementType::CO2, value, now);
+            return ReadStatus::Ok;
         } else {
-            logger.log(Logger::Level::Warning, "Reading CO2 concentration failed: %u", (uint32_t)sensor.errorCode);
+            logger.log(Logger::Level::Warning, "Reading CO2 concentration failed: sensor reported 0 ppm");
         }
-        return false;
+        return ReadStatus::Failed;
+    }
+
+    Stats getStats() const {
+        return Stats{
+            requests.load(),
+            timeouts.load(),
+            checksum_errors.load(),
+            last_latency_micros.load(),
+            max_latency_micros.load()
+        };
     }
-};
\ No newline at end of file
+};
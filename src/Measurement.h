@@ -1,86 +1,117 @@
 #pragma once
 
-#include <string>
-#include <format>
-
-#include "ArduinoJson.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
 
 enum class MeasurementType { Temperature, Humidity, PM1, PM25, PM10, CO2 };
 enum class MeasurementUnit { DegreesCelsius, Percent, PPM, MicroGramPerCubicMeter };
 
-class MeasurementDetails {
-    private:
-        const MeasurementType type_;     
-        const MeasurementUnit unit_;
-    
-    public:
-        MeasurementDetails(MeasurementType type, MeasurementUnit unit) 
-            : type_(type)
-            , unit_(unit) {
-        }
-
-        MeasurementType getType() const {
-            return type_;
-        }
-
-        MeasurementUnit getUnit() const {
-            return unit_;
-        }
-};
-
-class Measurement {
-    private:
-        const MeasurementDetails details_;
-        const std::string formatted_value_;
-
-    protected:
-        Measurement(MeasurementDetails details, std::string formatted_value) 
-            : details_(details)
-            , formatted_value_(std::move(formatted_value)) {
-        }
-
-    public:
-        virtual ~Measurement() = default;
-
-        MeasurementDetails getDetails() const {
-            return details_;
+static constexpr size_t measurement_type_count = 6;
+
+constexpr MeasurementUnit unitOf(MeasurementType type) {
+    switch (type) {
+        case MeasurementType::Temperature: return MeasurementUnit::DegreesCelsius;
+        case MeasurementType::Humidity: return MeasurementUnit::Percent;
+        case MeasurementType::CO2: return MeasurementUnit::PPM;
+        default: return MeasurementUnit::MicroGramPerCubicMeter;
+    }
+}
+
+// PM and CO2 sensors report integral values, everything else is printed with two decimals.
+constexpr bool isRoundNumber(MeasurementType type) {
+    return type == MeasurementType::PM1
+        || type == MeasurementType::PM25
+        || type == MeasurementType::PM10
+        || type == MeasurementType::CO2;
+}
+
+// Values are stored as fixed point where space matters: two decimals for
+// temperature and humidity, whole numbers for PM and CO2.
+constexpr double fixedPointScaleOf(MeasurementType type) {
+    return isRoundNumber(type) ? 1.0 : 100.0;
+}
+
+// One slot per MeasurementType, filled in place by the sensor drivers.
+// Plain data only: copying a frame never touches the heap, and values are
+// only turned into text when a consumer asks for it.
+struct SampleFrame {
+    uint8_t valid_mask = 0;
+    // Bumped by every change, so a consumer can tell whether there is anything new since its last look.
+    uint32_t generation = 0;
+    std::array<double, measurement_type_count> values{};
+    std::array<uint32_t, measurement_type_count> timestamps{};
+
+    static constexpr size_t indexOf(MeasurementType type) {
+        return static_cast<size_t>(type);
+    }
+
+    void set(MeasurementType type, double value, uint32_t timestamp_millis) {
+        const size_t index = indexOf(type);
+        values[index] = value;
+        timestamps[index] = timestamp_millis;
+        valid_mask |= (1u << index);
+        generation++;
+    }
+
+    bool has(MeasurementType type) const {
+        return valid_mask & (1u << indexOf(type));
+    }
+
+    double get(MeasurementType type) const {
+        return values[indexOf(type)];
+    }
+
+    uint32_t timestampOf(MeasurementType type) const {
+        return timestamps[indexOf(type)];
+    }
+
+    void remove(MeasurementType type) {
+        valid_mask &= ~(1u << indexOf(type));
+        generation++;
+    }
+
+    bool empty() const {
+        return valid_mask == 0;
+    }
+
+    void clear() {
+        valid_mask = 0;
+        generation++;
+    }
+
+    // Copies every valid slot of `other` over this frame, leaving the rest untouched.
+    void merge(const SampleFrame& other) {
+        if (other.empty()) return;
+        for (size_t index = 0; index < measurement_type_count; index++) {
+            if (other.valid_mask & (1u << index)) {
+                values[index] = other.values[index];
+                timestamps[index] = other.timestamps[index];
+            }
         }
-
-        const std::string& valueToString() const {
-            return formatted_value_;
-        }
-};
-
-class DecimalMeasurement : public Measurement 
-{
-    private:
-        const double value_;
-
-    public:
-        DecimalMeasurement(MeasurementDetails details, double value)
-            : Measurement(details, std::format("{:.2f}", value))
-            , value_(value) 
-        {                
-        }
-
-        double getValue() const {
-            return value_;
+        valid_mask |= other.valid_mask;
+        generation++;
+    }
+
+    // Returns the first valid slot at or after `from`, wrapping around.
+    // Only meaningful on a non-empty frame.
+    size_t nextValidIndex(size_t from) const {
+        for (size_t i = 0; i < measurement_type_count; i++) {
+            const size_t index = (from + i) % measurement_type_count;
+            if (valid_mask & (1u << index)) {
+                return index;
+            }
         }
+        return 0;
+    }
+
+    // Writes the slot's value as text into `buffer` and returns its length.
+    size_t formatValue(MeasurementType type, char* buffer, size_t size) const {
+        int written = isRoundNumber(type)
+            ? snprintf(buffer, size, "%u", static_cast<uint32_t>(get(type)))
+            : snprintf(buffer, size, "%.2f", get(type));
+        if (written < 0) return 0;
+        return static_cast<size_t>(written) < size ? static_cast<size_t>(written) : size - 1;
+    }
 };
-
-class RoundNumberMeasurement : public Measurement
-{
-    private:
-        const uint32_t value_;
-
-    public:
-        RoundNumberMeasurement(MeasurementDetails details, uint32_t value) 
-            : Measurement(details, std::to_string(value))
-            , value_(value)
-        {            
-        }
-
-        uint32_t getValue() const {
-            return value_;
-        }
-};
\ No newline at end of file
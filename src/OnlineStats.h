@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "Measurement.h"
+
+// P² estimator for a single quantile (Jain & Chlamtac, 1985). Tracks five
+// markers whose heights converge on the quantile without storing samples.
+class P2Quantile {
+private:
+    const double p_;
+    std::array<double, 5> heights_{};
+    std::array<double, 5> positions_{};
+    std::array<double, 5> desired_{};
+    const std::array<double, 5> increments_;
+    uint32_t count_ = 0;
+
+    double parabolic(size_t i, double d) const {
+        const double n_prev = positions_[i - 1], n = positions_[i], n_next = positions_[i + 1];
+        return heights_[i] + d / (n_next - n_prev) * (
+            (n - n_prev + d) * (heights_[i + 1] - heights_[i]) / (n_next - n) +
+            (n_next - n - d) * (heights_[i] - heights_[i - 1]) / (n - n_prev));
+    }
+
+    double linear(size_t i, double d) const {
+        const size_t j = d > 0 ? i + 1 : i - 1;
+        return heights_[i] + d * (heights_[j] - heights_[i]) / (positions_[j] - positions_[i]);
+    }
+
+public:
+    explicit P2Quantile(double p)
+        : p_(p)
+        , increments_{ 0, p / 2, p, (1 + p) / 2, 1 } {
+    }
+
+    void add(double x) {
+        if (count_ < 5) {
+            heights_[count_++] = x;
+            if (count_ == 5) {
+                std::sort(heights_.begin(), heights_.end());
+                positions_ = { 1, 2, 3, 4, 5 };
+                desired_ = { 1, 1 + 2 * p_, 1 + 4 * p_, 3 + 2 * p_, 5 };
+            }
+            return;
+        }
+        count_++;
+
+        size_t k = 0;
+        if (x < heights_[0]) {
+            heights_[0] = x;
+        } else if (x >= heights_[4]) {
+            heights_[4] = x;
+            k = 3;
+        } else {
+            while (x >= heights_[k + 1]) k++;
+        }
+
+        for (size_t i = k + 1; i < 5; i++) positions_[i] += 1;
+        for (size_t i = 0; i < 5; i++) desired_[i] += increments_[i];
+
+        for (size_t i = 1; i <= 3; i++) {
+            const double offset = desired_[i] - positions_[i];
+            if ((offset >= 1 && positions_[i + 1] - positions_[i] > 1) ||
+                (offset <= -1 && positions_[i - 1] - positions_[i] < -1)) {
+                const double d = offset > 0 ? 1 : -1;
+                double height = parabolic(i, d);
+                if (!(heights_[i - 1] < height && height < heights_[i + 1])) {
+                    height = linear(i, d);
+                }
+                heights_[i] = height;
+                positions_[i] += d;
+            }
+        }
+    }
+
+    double value() const {
+        if (count_ >= 5) return heights_[2];
+        if (count_ == 0) return 0;
+
+        std::array<double, 5> sorted = heights_;
+        std::sort(sorted.begin(), sorted.begin() + count_);
+        return sorted[static_cast<size_t>(std::lround(p_ * (count_ - 1)))];
+    }
+};
+
+struct StatsSummary {
+    uint32_t count;
+    double last;
+    double ewma;
+    double mean;
+    double stddev;
+    double p50;
+    double p95;
+};
+
+// Running statistics over one series in constant memory: EWMA, Welford
+// mean/variance since boot and P² median and 95th percentile.
+class OnlineStats {
+public:
+    // Roughly the last ten samples dominate the EWMA.
+    static constexpr double ewma_alpha = 0.1;
+
+private:
+    uint32_t count_ = 0;
+    double last_ = 0;
+    double ewma_ = 0;
+    double mean_ = 0;
+    double m2_ = 0;
+    P2Quantile p50_{ 0.5 };
+    P2Quantile p95_{ 0.95 };
+
+public:
+    void add(double x) {
+        count_++;
+        last_ = x;
+        ewma_ = count_ == 1 ? x : ewma_ + ewma_alpha * (x - ewma_);
+
+        const double delta = x - mean_;
+        mean_ += delta / count_;
+        m2_ += delta * (x - mean_);
+
+        p50_.add(x);
+        p95_.add(x);
+    }
+
+    StatsSummary summary() const {
+        const double variance = count_ > 1 ? m2_ / (count_ - 1) : 0;
+        return StatsSummary{ count_, last_, ewma_, mean_, std::sqrt(variance), p50_.value(), p95_.value() };
+    }
+
+    uint32_t count() const { return count_; }
+};
+
+// One OnlineStats per MeasurementType, fed with every raw sample.
+class MeasurementStatistics {
+private:
+    std::array<OnlineStats, measurement_type_count> stats_{};
+    mutable std::mutex mutex_;
+
+public:
+    void add(const SampleFrame& frame) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t index = 0; index < measurement_type_count; index++) {
+            if (frame.valid_mask & (1u << index)) {
+                stats_[index].add(frame.values[index]);
+            }
+        }
+    }
+
+    bool has(MeasurementType type) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_[static_cast<size_t>(type)].count() > 0;
+    }
+
+    StatsSummary summary(MeasurementType type) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_[static_cast<size_t>(type)].summary();
+    }
+};
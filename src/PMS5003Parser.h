@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Decoded PMS5003 data frame (all 13 data words of the 32-byte message).
+struct PMS5003Frame {
+    uint16_t pm_standard[3];    // PM1.0, PM2.5, PM10 in µg/m³ (CF=1, standard particle)
+    uint16_t pm_atmospheric[3]; // PM1.0, PM2.5, PM10 in µg/m³ (atmospheric environment)
+    uint16_t particles[6];      // Particles per 0.1 L beyond 0.3, 0.5, 1.0, 2.5, 5.0 and 10 µm
+    uint8_t version;
+    uint8_t error_code;
+};
+
+// Incremental parser for the PMS5003 serial protocol. Works directly on the
+// bytes still sitting in the receive ring: header, length and checksum are
+// validated in place as data trickles in, and a frame is decoded straight out
+// of the ring before its bytes are released. Garbage is skipped byte by byte
+// until the next valid header.
+class PMS5003Parser {
+public:
+    static constexpr size_t frame_length = 32;
+
+    struct Counters {
+        uint32_t frames = 0;
+        uint32_t skipped_bytes = 0;
+        uint32_t length_errors = 0;
+        uint32_t checksum_errors = 0;
+    };
+
+private:
+    static constexpr uint8_t start_byte_1 = 0x42;
+    static constexpr uint8_t start_byte_2 = 0x4D;
+    static constexpr uint16_t data_length = frame_length - 4;
+    static constexpr size_t checksum_offset = frame_length - 2;
+
+    size_t checked_ = 0;
+    uint16_t sum_ = 0;
+    Counters counters_;
+
+    template <typename Ring>
+    static uint16_t word(const Ring& ring, size_t offset) {
+        return static_cast<uint16_t>(ring.peek(offset) << 8 | ring.peek(offset + 1));
+    }
+
+    template <typename Ring>
+    void skip(Ring& ring) {
+        ring.discard(1);
+        checked_ = 0;
+        sum_ = 0;
+    }
+
+public:
+    const Counters& getCounters() const {
+        return counters_;
+    }
+
+    void reset() {
+        checked_ = 0;
+        sum_ = 0;
+    }
+
+    // Consumes bytes from `ring` until a complete, valid frame has been decoded into
+    // `frame` (returns true) or more data is needed (returns false).
+    template <typename Ring>
+    bool parse(Ring& ring, PMS5003Frame& frame) {
+        for (;;) {
+            const size_t available = ring.size();
+
+            if (checked_ == 0) {
+                if (available < 2) return false;
+                if (ring.peek(0) != start_byte_1 || ring.peek(1) != start_byte_2) {
+                    counters_.skipped_bytes++;
+                    skip(ring);
+                    continue;
+                }
+            }
+
+            if (available < 4) return false;
+            if (word(ring, 2) != data_length) {
+                counters_.length_errors++;
+                skip(ring);
+                continue;
+            }
+
+            const size_t to_check = available < checksum_offset ? available : checksum_offset;
+            for (; checked_ < to_check; checked_++) {
+                sum_ += ring.peek(checked_);
+            }
+
+            if (available < frame_length) return false;
+
+            if (sum_ != word(ring, checksum_offset)) {
+                counters_.checksum_errors++;
+                skip(ring);
+                continue;
+            }
+
+            for (size_t i = 0; i < 3; i++) {
+                frame.pm_standard[i] = word(ring, 4 + 2 * i);
+                frame.pm_atmospheric[i] = word(ring, 10 + 2 * i);
+            }
+            for (size_t i = 0; i < 6; i++) {
+                frame.particles[i] = word(ring, 16 + 2 * i);
+            }
+            frame.version = ring.peek(28);
+            frame.error_code = ring.peek(29);
+
+            ring.discard(frame_length);
+            reset();
+            counters_.frames++;
+            return true;
+        }
+    }
+};
@@ -1,74 +1,131 @@
 #pragma once
 
-#include "PMserial.h"
+#include <array>
+#include <atomic>
+#include <HardwareSerial.h>
 
+#include "PMS5003Parser.h"
 #include "Sensor.h"
+#include "SpscRing.h"
 #include "Logger.h"
 
+// PMS5003 on a hardware UART in active mode. Received bytes are pushed into a
+// lock-free ring from the UART event task and parsed in place on the sensor
+// task, so nothing is bit-banged and no bytes are lost to WiFi interrupts.
 class PMWrapper : public SensorDriver {
 
+public:
+    static constexpr const char* name = "PMS5003";
+    static constexpr std::array<SensorEntity, 3> entities = {{
+        { MeasurementType::PM1, "pm1", "PM1", "pm1", "µg/m³" },
+        { MeasurementType::PM25, "pm25", "PM2.5", "pm25", "µg/m³" },
+        { MeasurementType::PM10, "pm10", "PM10", "pm10", "µg/m³" }
+    }};
+
 private:
-    const MeasurementDetails pm1_details = MeasurementDetails(MeasurementType::PM1, MeasurementUnit::MicroGramPerCubicMeter);
-    const MeasurementDetails pm25_details = MeasurementDetails(MeasurementType::PM25, MeasurementUnit::MicroGramPerCubicMeter);
-    const MeasurementDetails pm10_details = MeasurementDetails(MeasurementType::PM10, MeasurementUnit::MicroGramPerCubicMeter);
+    static constexpr uint32_t baud_rate = 9600;
+    static constexpr uint32_t settle_duration_millis = 30000; // PMS5003 needs ~30s to stabilize after wake
+    static constexpr uint32_t frame_timeout_millis = 3000;    // Active mode sends a frame every ~1-2s
+
+    static constexpr uint8_t command_sleep[] = { 0x42, 0x4D, 0xE4, 0x00, 0x00, 0x01, 0x73 };
+    static constexpr uint8_t command_wake[] = { 0x42, 0x4D, 0xE4, 0x00, 0x01, 0x01, 0x74 };
+    static constexpr uint8_t command_active_mode[] = { 0x42, 0x4D, 0xE1, 0x00, 0x01, 0x01, 0x71 };
 
-    SerialPM sensor;
+    HardwareSerial& serial;
+    const int8_t rx_pin;
+    const int8_t tx_pin;
+
+    SpscRing<256> rx_ring;
+    PMS5003Parser parser;
+    PMS5003Frame last_frame{};
+    std::atomic<bool> accepting{false};
+    uint32_t read_start_millis = 0;
+
+    // Runs on the UART event task.
+    void receive() {
+        if (!accepting.load()) {
+            uint8_t scratch[PMS5003Parser::frame_length];
+            while (serial.available() > 0) {
+                serial.read(scratch, sizeof(scratch));
+            }
+            return;
+        }
+
+        rx_ring.fill([this](uint8_t* dest, size_t max) {
+            return serial.read(dest, std::min<size_t>(max, serial.available()));
+        });
+    }
 
 public:
-    PMWrapper(PMS type, uint8_t rx_pin, uint8_t tx_pin)
-        : sensor(type, rx_pin, tx_pin) {
+    PMWrapper(HardwareSerial& serial, int8_t rx_pin, int8_t tx_pin)
+        : serial(serial)
+        , rx_pin(rx_pin)
+        , tx_pin(tx_pin) {
     }
 
-    bool begin() override {
-        sensor.init();
-        sensor.sleep();
+    bool begin() {
+        serial.begin(baud_rate, SERIAL_8N1, rx_pin, tx_pin);
+        serial.onReceive([this]() { receive(); });
+        serial.write(command_active_mode, sizeof(command_active_mode));
+        serial.write(command_sleep, sizeof(command_sleep));
         return true;
     }
 
-    bool provideMeasurements(std::vector<std::unique_ptr<Measurement>>& measurements) override {
-        bool success(false);
+    uint32_t wake() {
+        accepting.store(false);
+        serial.write(command_wake, sizeof(command_wake));
+        return settle_duration_millis;
+    }
 
-        sensor.wake();
-        delay(30000); // PMS5003 needs ~30s to stabilize after wake
-        sensor.read();
+    void sleep() {
+        serial.write(command_sleep, sizeof(command_sleep));
+    }
 
-        if (sensor) {
-          measurements.push_back(std::make_unique<RoundNumberMeasurement>(pm1_details, sensor.pm01));
-          measurements.push_back(std::make_unique<RoundNumberMeasurement>(pm25_details, sensor.pm25));
-          measurements.push_back(std::make_unique<RoundNumberMeasurement>(pm10_details, sensor.pm10));
-          success = true;
+    ReadStatus read(uint32_t now, SampleFrame& frame) {
+        if (!accepting.load()) {
+            // Only accept frames measured after the fan had time to settle.
+            rx_ring.clear();
+            parser.reset();
+            read_start_millis = now;
+            accepting.store(true);
+            return ReadStatus::Pending;
         }
-        else {
-          switch (sensor.status) {
-            case sensor.OK: // should never come here
-              break;     // included to compile without warnings
-            case sensor.ERROR_TIMEOUT:
-              logger.log(Logger::Level::Error, "Reading PMS failed: timeout");
-              break;
-            case sensor.ERROR_MSG_UNKNOWN:
-              logger.log(Logger::Level::Error, "Reading PMS failed: unknown message");
-              break;
-            case sensor.ERROR_MSG_HEADER:
-              logger.log(Logger::Level::Error, "Reading PMS failed: header error");
-              break;
-            case sensor.ERROR_MSG_BODY:
-              logger.log(Logger::Level::Error, "Reading PMS failed: body error");
-              break;
-            case sensor.ERROR_MSG_START:
-              logger.log(Logger::Level::Error, "Reading PMS failed: start error");
-              break;
-            case sensor.ERROR_MSG_LENGTH:
-              logger.log(Logger::Level::Error, "Reading PMS failed: length error");
-              break;
-            case sensor.ERROR_MSG_CKSUM:
-              logger.log(Logger::Level::Error, "Reading PMS failed: checksum error");
-              break;
-            case sensor.ERROR_PMS_TYPE:
-              logger.log(Logger::Level::Error, "Reading PMS failed: pms type error");
-              break;
-          }
+
+        bool received = false;
+        while (parser.parse(rx_ring, last_frame)) {
+            received = true;
         }
-        sensor.sleep();
-        return success;
+
+        if (!received) {
+            if (now - read_start_millis < frame_timeout_millis) {
+                return ReadStatus::Pending;
+            }
+            const PMS5003Parser::Counters& counters = parser.getCounters();
+            logger.log(Logger::Level::Error, "Reading PMS failed: timeout (%u skipped bytes, %u length errors, %u checksum errors)",
+                       counters.skipped_bytes, counters.length_errors, counters.checksum_errors);
+            accepting.store(false);
+            return ReadStatus::Failed;
+        }
+
+        accepting.store(false);
+
+        if (last_frame.error_code != 0) {
+            logger.log(Logger::Level::Error, "Reading PMS failed: sensor error code %u", last_frame.error_code);
+            return ReadStatus::Failed;
+        }
+
+        frame.set(MeasurementType::PM1, last_frame.pm_atmospheric[0], now);
+        frame.set(MeasurementType::PM25, last_frame.pm_atmospheric[1], now);
+        frame.set(MeasurementType::PM10, last_frame.pm_atmospheric[2], now);
+        return ReadStatus::Ok;
+    }
+
+    // Full content of the most recent valid frame, including the particle count bins.
+    const PMS5003Frame& getLastFrame() const {
+        return last_frame;
+    }
+
+    const PMS5003Parser::Counters& getParserCounters() const {
+        return parser.getCounters();
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <esp_partition.h>
+
+#include "FlashRegion.h"
+
+// A data partition from partitions.csv, accessed without a file system.
+class PartitionFlashRegion : public FlashRegion {
+private:
+    const esp_partition_t* partition_ = nullptr;
+
+public:
+    bool begin(const char* label) {
+        partition_ = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+        return partition_ != nullptr;
+    }
+
+    size_t size() const override {
+        return partition_ ? partition_->size : 0;
+    }
+
+    bool read(size_t offset, void* data, size_t length) override {
+        return partition_ && esp_partition_read(partition_, offset, data, length) == ESP_OK;
+    }
+
+    bool write(size_t offset, const void* data, size_t length) override {
+        return partition_ && esp_partition_write(partition_, offset, data, length) == ESP_OK;
+    }
+
+    bool eraseSector(size_t offset) override {
+        return partition_ && esp_partition_erase_range(partition_, offset, sector_size) == ESP_OK;
+    }
+};
@@ -3,6 +3,8 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 
+#include <array>
+#include <atomic>
 #include <string>
 #include <memory>
 #include <mutex>
@@ -13,17 +15,45 @@
 #include <vector>
 #include <algorithm>
 
+#include "SpscRing.h"
 #include "ha/MqttClient.h"
 
+// MQTT client that runs all network I/O on its own task. Connecting, the
+// PubSubClient loop and the actual writes happen there, so a broker that is
+// down or slow can never stall the caller. The application talks to the task
+// through two lock-free rings: publish() queues outgoing messages and loop()
+// hands received messages to the callback on the caller's task.
 class ReconnectingPubSubClient : public ha::MqttClient {
 public:
     using MessageCallback = std::function<void(char*, uint8_t*, unsigned int)>;
 
     enum class Error { None, ReconnectFailed, PublishFailed };
 
+    struct Stats {
+        uint32_t connect_attempts;
+        uint32_t dropped_publishes; // outbox full, or lost with the connection
+        uint32_t dropped_messages;  // inbox full
+        size_t outbox_bytes;
+    };
+
 private:
+    enum class State { Idle, Resolving, Connecting, Handshake, Connected };
+
+    struct MessageHeader {
+        uint16_t topic_length;
+        uint16_t payload_length;
+        bool retain;
+        bool by_reference; // the ring holds a pointer to the payload instead of its bytes
+    };
+
+    static constexpr size_t max_topic_length = 127;
+    static constexpr size_t max_inbound_payload = 512;
+    static constexpr uint32_t connect_timeout_ms = 3000;
+    static constexpr uint16_t socket_timeout_s = 3;
+    static constexpr size_t max_publishes_per_step = 8;
+
     WiFiClient wifi_client_;
-    mutable PubSubClient pubsub_client_;
+    PubSubClient pubsub_client_;
     const std::string broker_;
     const uint16_t port_;
     const std::string mqtt_user_;
@@ -35,6 +65,9 @@ private:
     const bool lwt_retain_;
     const int lwt_qos_;
 
+    // Network task state, never touched by other tasks.
+    State state_ = State::Idle;
+    IPAddress broker_ip_;
     uint32_t last_connection_attempt_timestamp_ = 0;
     uint32_t current_backoff_ms_ = 1000;
 
@@ -42,73 +75,221 @@ private:
     static constexpr uint32_t max_backoff_ms = 60000;
 
     std::vector<std::string> subscribed_topics_;
-    
-    mutable std::recursive_mutex mqtt_mutex_;
-
-    bool establishConnectionToBroker() {
-        std::lock_guard<std::recursive_mutex> lock(mqtt_mutex_);
-        
-        if (pubsub_client_.connected()) {
-            current_backoff_ms_ = min_backoff_ms;
-            return true;
-        }
+    std::mutex subscriptions_mutex_;
 
-        const uint32_t now = millis();
-        if (now - last_connection_attempt_timestamp_ < current_backoff_ms_ &&
-            last_connection_attempt_timestamp_ != 0) {
-            return false;
-        }
-        
-        if (WiFi.status() != WL_CONNECTED) {
-            return false;
-        }
+    SpscRing<8192> outbox_;    // application → network task
+    SpscRing<2048> inbox_;     // network task → application
+    std::mutex outbox_mutex_;  // orders concurrent publishers; the network task never takes it
 
-        last_connection_attempt_timestamp_ = now;
+    ha::MqttClient::MessageCallback callback_;
+    TaskHandle_t task_handle_ = nullptr;
 
-        const char* user_ptr = mqtt_user_.empty() ? nullptr : mqtt_user_.c_str();
-        const char* pass_ptr = mqtt_password_.empty() ? nullptr : mqtt_password_.c_str();
+    std::atomic<bool> connected_{false};
+    std::atomic<bool> resubscribe_{false};
+    std::atomic<bool> disconnect_requested_{false};
+    std::atomic<uint32_t> connect_attempts_{0};
+    std::atomic<uint32_t> connections_{0};
+    std::atomic<uint32_t> dropped_publishes_{0};
+    std::atomic<uint32_t> dropped_messages_{0};
 
-        // Ensure we're using the correct address type
-        IPAddress broker_ip;
-        if (broker_ip.fromString(broker_.c_str())) {
-             pubsub_client_.setServer(broker_ip, port_);
-        } else {
-             pubsub_client_.setServer(broker_.c_str(), port_);
-        }
+    // ── Rings ─────────────────────────────────────────────────
 
-        logger.log(Logger::Level::Info, "Attempting MQTT connection to %s:%d as %s", 
-                   broker_.c_str(), port_, client_id_.c_str());
+    static size_t storedPayloadSize(const MessageHeader& header) {
+        return header.by_reference ? sizeof(const char*) : header.payload_length;
+    }
 
-        bool connected = false;
-        if (!lwt_topic_.empty()) {
-            connected = pubsub_client_.connect(client_id_.c_str(), user_ptr, pass_ptr, 
-                                             lwt_topic_.c_str(), lwt_qos_, lwt_retain_, lwt_payload_.c_str());
+    template <size_t N>
+    static bool enqueue(SpscRing<N>& ring, std::string_view topic, std::string_view payload, bool retain,
+                        bool by_reference = false) {
+        const MessageHeader header{ static_cast<uint16_t>(topic.size()), static_cast<uint16_t>(payload.size()),
+                                    retain, by_reference };
+        const size_t size = sizeof(header) + topic.size() + storedPayloadSize(header);
+        if (topic.size() > max_topic_length || payload.size() > UINT16_MAX || ring.available() < size) {
+            return false;
+        }
+
+        ring.stage(0, reinterpret_cast<const uint8_t*>(&header), sizeof(header));
+        ring.stage(sizeof(header), reinterpret_cast<const uint8_t*>(topic.data()), topic.size());
+        if (by_reference) {
+            const char* data = payload.data();
+            ring.stage(sizeof(header) + topic.size(), reinterpret_cast<const uint8_t*>(&data), sizeof(data));
         } else {
-            connected = pubsub_client_.connect(client_id_.c_str(), user_ptr, pass_ptr);
+            ring.stage(sizeof(header) + topic.size(), reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
         }
+        ring.commit(size);
+        return true;
+    }
 
-        if (!connected) {
-            int state = pubsub_client_.state();
-            logger.log(Logger::Level::Warning, "MQTT connect failed (state %d), retry in %ums",
-                       state, current_backoff_ms_);
-            
-            // Explicitly stop the client on failure to clear the socket
-            wifi_client_.stop();
+    // Reads the header and the NUL-terminated topic of the oldest message. Returns false if the ring is empty.
+    template <size_t N>
+    static bool front(const SpscRing<N>& ring, MessageHeader& header, std::array<char, max_topic_length + 1>& topic) {
+        if (ring.size() < sizeof(header)) return false;
+        ring.read(0, reinterpret_cast<uint8_t*>(&header), sizeof(header));
+        ring.read(sizeof(header), reinterpret_cast<uint8_t*>(topic.data()), header.topic_length);
+        topic[header.topic_length] = '\0';
+        return true;
+    }
 
-            current_backoff_ms_ = std::min(current_backoff_ms_ * 2, max_backoff_ms);
-            return false;
+    template <size_t N>
+    static void pop(SpscRing<N>& ring, const MessageHeader& header) {
+        ring.discard(sizeof(header) + header.topic_length + storedPayloadSize(header));
+    }
+
+    // ── Network task ──────────────────────────────────────────
+
+    static void taskEntry(void* parameter) {
+        auto* self = static_cast<ReconnectingPubSubClient*>(parameter);
+        for (;;) {
+            self->step();
+            vTaskDelay(pdMS_TO_TICKS(self->state_ == State::Connected ? 10 : 100));
         }
+    }
 
-        logger.log(Logger::Level::Info, "MQTT connected");
-        current_backoff_ms_ = min_backoff_ms;
+    void failConnection(const char* stage) {
+        logger.log(Logger::Level::Warning, "MQTT connect failed at %s (state %d), retry in %ums",
+                   stage, pubsub_client_.state(), current_backoff_ms_);
+        // Explicitly stop the client on failure to clear the socket
+        wifi_client_.stop();
+        current_backoff_ms_ = std::min(current_backoff_ms_ * 2, max_backoff_ms);
+        state_ = State::Idle;
+    }
 
+    void subscribeAll() {
+        std::lock_guard<std::mutex> lock(subscriptions_mutex_);
         for (const auto& topic : subscribed_topics_) {
             pubsub_client_.subscribe(topic.c_str());
         }
+    }
+
+    // One bounded step of the connection state machine. Each stage does at most
+    // one operation with its own timeout, so the task keeps cycling.
+    void step() {
+        switch (state_) {
+            case State::Idle: {
+                const uint32_t now = millis();
+                if (last_connection_attempt_timestamp_ != 0 &&
+                    now - last_connection_attempt_timestamp_ < current_backoff_ms_) {
+                    return;
+                }
+                if (WiFi.status() != WL_CONNECTED) return;
+
+                last_connection_attempt_timestamp_ = now;
+                connect_attempts_++;
+                state_ = State::Resolving;
+                return;
+            }
+
+            case State::Resolving:
+                // Ensure we're using the correct address type
+                if (!broker_ip_.fromString(broker_.c_str()) && !WiFi.hostByName(broker_.c_str(), broker_ip_)) {
+                    failConnection("DNS lookup");
+                    return;
+                }
+                state_ = State::Connecting;
+                return;
+
+            case State::Connecting:
+                logger.log(Logger::Level::Info, "Attempting MQTT connection to %s:%d as %s",
+                           broker_.c_str(), port_, client_id_.c_str());
+                if (!wifi_client_.connect(broker_ip_, port_, connect_timeout_ms)) {
+                    failConnection("TCP connect");
+                    return;
+                }
+                state_ = State::Handshake;
+                return;
+
+            case State::Handshake: {
+                // The socket is already open, so PubSubClient only exchanges CONNECT/CONNACK.
+                pubsub_client_.setServer(broker_ip_, port_);
+                const char* user_ptr = mqtt_user_.empty() ? nullptr : mqtt_user_.c_str();
+                const char* pass_ptr = mqtt_password_.empty() ? nullptr : mqtt_password_.c_str();
+
+                bool connected = false;
+                if (!lwt_topic_.empty()) {
+                    connected = pubsub_client_.connect(client_id_.c_str(), user_ptr, pass_ptr,
+                                                       lwt_topic_.c_str(), lwt_qos_, lwt_retain_, lwt_payload_.c_str());
+                } else {
+                    connected = pubsub_client_.connect(client_id_.c_str(), user_ptr, pass_ptr);
+                }
+                if (!connected) {
+                    failConnection("MQTT handshake");
+                    return;
+                }
+
+                logger.log(Logger::Level::Info, "MQTT connected");
+                current_backoff_ms_ = min_backoff_ms;
+                resubscribe_.store(false);
+                subscribeAll();
+                state_ = State::Connected;
+                connections_++;
+                connected_.store(true);
+                return;
+            }
+
+            case State::Connected:
+                if (disconnect_requested_.exchange(false)) {
+                    pubsub_client_.disconnect();
+                }
+                if (!pubsub_client_.loop()) {
+                    closeConnection("MQTT connection lost");
+                    return;
+                }
+                if (resubscribe_.exchange(false)) subscribeAll();
+                if (!sendPendingPublishes()) closeConnection("MQTT connection closed after a failed publish");
+                return;
+        }
+    }
+
+    void closeConnection(const char* reason) {
+        logger.log(Logger::Level::Warning, "%s", reason);
+        connected_.store(false);
+        wifi_client_.stop();
+        dropPendingPublishes();
+        state_ = State::Idle;
+    }
 
+    // Returns false if a publish failed. The stream may then hold a partial packet,
+    // so the connection has to go; an empty outbox always means everything was written.
+    bool sendPendingPublishes() {
+        MessageHeader header;
+        std::array<char, max_topic_length + 1> topic;
+        std::array<uint8_t, 128> chunk;
+
+        for (size_t sent = 0; sent < max_publishes_per_step && front(outbox_, header, topic); sent++) {
+            const size_t payload_offset = sizeof(header) + header.topic_length;
+            bool ok = pubsub_client_.beginPublish(topic.data(), header.payload_length, header.retain);
+            if (header.by_reference) {
+                const uint8_t* data = nullptr;
+                outbox_.read(payload_offset, reinterpret_cast<uint8_t*>(&data), sizeof(data));
+                ok = ok && pubsub_client_.write(data, header.payload_length) == header.payload_length;
+            } else {
+                for (size_t offset = 0; ok && offset < header.payload_length; offset += chunk.size()) {
+                    const size_t n = std::min<size_t>(chunk.size(), header.payload_length - offset);
+                    outbox_.read(payload_offset + offset, chunk.data(), n);
+                    ok = pubsub_client_.write(chunk.data(), n) == n;
+                }
+            }
+            ok = ok && pubsub_client_.endPublish();
+            pop(outbox_, header);
+
+            if (!ok) {
+                dropped_publishes_++;
+                logger.log(Logger::Level::Warning, "MQTT publish failed: %d", pubsub_client_.getWriteError());
+                return false;
+            }
+        }
         return true;
     }
 
+    void dropPendingPublishes() {
+        MessageHeader header;
+        std::array<char, max_topic_length + 1> topic;
+        while (front(outbox_, header, topic)) {
+            pop(outbox_, header);
+            dropped_publishes_++;
+        }
+    }
+
 public:
     ReconnectingPubSubClient(std::string_view broker,
                              uint16_t port,
@@ -131,76 +312,104 @@ public:
         , lwt_qos_(lwt_qos)
     {
         pubsub_client_.setBufferSize(2048);
+        pubsub_client_.setSocketTimeout(socket_timeout_s);
+        pubsub_client_.setCallback([this](char* topic, uint8_t* payload, unsigned int length) {
+            // Runs on the network task, which is the inbox's only producer.
+            if (length > max_inbound_payload ||
+                !enqueue(inbox_, topic, std::string_view(reinterpret_cast<const char*>(payload), length), false)) {
+                dropped_messages_++;
+            }
+        });
+    }
+
+    // Starts the network task. Subscriptions and the callback may be set before or after.
+    void begin() {
+        if (task_handle_) return;
+        xTaskCreatePinnedToCore(taskEntry, "MqttTask", 6144, this, 1, &task_handle_, 0);
     }
 
+    // The callback is invoked from loop(), on the caller's task.
     void setCallback(ha::MqttClient::MessageCallback callback) override {
-        std::lock_guard<std::recursive_mutex> lock(mqtt_mutex_);
-        pubsub_client_.setCallback([this, callback](char* topic, uint8_t* payload, unsigned int length) {
-            if (callback) {
-                callback(topic, payload, length);
-            }
-        });
+        callback_ = callback;
     }
 
     void subscribe(const std::string& topic) override {
-        std::lock_guard<std::recursive_mutex> lock(mqtt_mutex_);
-        auto it = std::find(subscribed_topics_.begin(), subscribed_topics_.end(), topic);
-        if (it == subscribed_topics_.end()) {
+        {
+            std::lock_guard<std::mutex> lock(subscriptions_mutex_);
+            auto it = std::find(subscribed_topics_.begin(), subscribed_topics_.end(), topic);
+            if (it != subscribed_topics_.end()) return;
             subscribed_topics_.push_back(topic);
         }
-        if (pubsub_client_.connected()) {
-            pubsub_client_.subscribe(topic.c_str());
-        }
+        resubscribe_.store(true);
     }
 
+    // Delivers the messages received since the last call. Never blocks on the network.
     void loop() {
-        std::lock_guard<std::recursive_mutex> lock(mqtt_mutex_);
-        if (establishConnectionToBroker()) {
-            pubsub_client_.loop();
+        MessageHeader header;
+        std::array<char, max_topic_length + 1> topic;
+        std::array<uint8_t, max_inbound_payload> payload;
+
+        while (front(inbox_, header, topic)) {
+            inbox_.read(sizeof(header) + header.topic_length, payload.data(), header.payload_length);
+            pop(inbox_, header);
+            if (callback_) {
+                callback_(std::string_view(topic.data(), header.topic_length), payload.data(), header.payload_length);
+            }
         }
     }
 
     bool isConnected() const override {
-        std::lock_guard<std::recursive_mutex> lock(mqtt_mutex_);
-        return pubsub_client_.connected();
+        return connected_.load();
+    }
+
+    uint32_t getConnectionCount() const override {
+        return connections_.load();
+    }
+
+    // Messages are removed from the outbox after they were written, or dropped with the connection.
+    bool isFlushed() const override {
+        return outbox_.size() == 0;
     }
 
     void disconnect() {
-        std::lock_guard<std::recursive_mutex> lock(mqtt_mutex_);
-        pubsub_client_.disconnect();
+        disconnect_requested_.store(true);
     }
 
+    // Queues the message for the network task. Returns false if not connected or the outbox is full.
     bool publish(std::string_view topic, std::string_view payload, bool retain = false) override {
-        std::lock_guard<std::recursive_mutex> lock(mqtt_mutex_);
-        if (pubsub_client_.connected()) {
-            std::string t(topic); 
-            
-            if (!pubsub_client_.publish(t.c_str(), (const uint8_t*)payload.data(), payload.size(), retain)) {
-                logger.log(Logger::Level::Warning, "MQTT publish failed: %d",
-                           pubsub_client_.getWriteError());
-                return false;
-            }
-            return true;
+        if (!connected_.load()) return false;
+
+        std::lock_guard<std::mutex> lock(outbox_mutex_);
+        if (!enqueue(outbox_, topic, payload, retain)) {
+            dropped_publishes_++;
+            logger.log(Logger::Level::Warning, "MQTT outbox full, dropping %u bytes for %.*s",
+                       static_cast<unsigned>(payload.size()), static_cast<int>(topic.size()), topic.data());
+            return false;
         }
-        return false;
+        return true;
     }
 
-    Error publishJson(std::string_view topic, const JsonDocument& data, bool retain = false) {
-        std::lock_guard<std::recursive_mutex> lock(mqtt_mutex_);
-        if (pubsub_client_.connected()) {
-            std::string buffer;
-            serializeJson(data, buffer);
-
-            std::string t(topic); 
-            if (!pubsub_client_.publish(t.c_str(), (const uint8_t*)buffer.data(), buffer.size(), retain)) {
-                logger.log(Logger::Level::Warning, "MQTT publish failed: %d",
-                           pubsub_client_.getWriteError());
-                return Error::PublishFailed;
-            }
+    // Queues only a pointer to `payload`; the network task writes it straight from there.
+    bool publishPersistent(std::string_view topic, std::string_view payload, bool retain = false) override {
+        if (!connected_.load()) return false;
 
-            return Error::None;
+        std::lock_guard<std::mutex> lock(outbox_mutex_);
+        if (!enqueue(outbox_, topic, payload, retain, true)) {
+            dropped_publishes_++;
+            return false;
         }
+        return true;
+    }
+
+    Error publishJson(std::string_view topic, const JsonDocument& data, bool retain = false) {
+        if (!connected_.load()) return Error::ReconnectFailed;
+
+        std::string buffer;
+        serializeJson(data, buffer);
+        return publish(topic, buffer, retain) ? Error::None : Error::PublishFailed;
+    }
 
-        return Error::ReconnectFailed;
+    Stats getStats() const {
+        return Stats{ connect_attempts_.load(), dropped_publishes_.load(), dropped_messages_.load(), outbox_.size() };
     }
 };
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+enum class FilterMode { Median, TrimmedMean };
+
+// Streaming filter stage for one measurement slot. Keeps the most recent raw
+// samples in a fixed ring and reduces them to a single value on demand.
+class SampleFilter {
+public:
+    static constexpr size_t capacity = 16;
+
+private:
+    std::array<double, capacity> ring_{};
+    size_t window_ = 1;
+    size_t count_ = 0;
+    size_t head_ = 0;
+    FilterMode mode_ = FilterMode::Median;
+
+public:
+    void configure(size_t window, FilterMode mode) {
+        window_ = window == 0 ? 1 : (window > capacity ? capacity : window);
+        mode_ = mode;
+        count_ = 0;
+        head_ = 0;
+    }
+
+    void push(double value) {
+        ring_[head_] = value;
+        head_ = (head_ + 1) % window_;
+        if (count_ < window_) count_++;
+    }
+
+    size_t size() const {
+        return count_;
+    }
+
+    double value() const {
+        if (count_ == 0) return 0;
+
+        std::array<double, capacity> sorted;
+        for (size_t i = 0; i < count_; i++) {
+            // Insertion sort, the window is tiny.
+            size_t j = i;
+            while (j > 0 && sorted[j - 1] > ring_[i]) {
+                sorted[j] = sorted[j - 1];
+                j--;
+            }
+            sorted[j] = ring_[i];
+        }
+
+        if (mode_ == FilterMode::Median) {
+            return count_ % 2 == 1
+                ? sorted[count_ / 2]
+                : (sorted[count_ / 2 - 1] + sorted[count_ / 2]) / 2.0;
+        }
+
+        // Drop the lowest and highest quarter, average the rest.
+        const size_t trim = count_ / 4;
+        double sum = 0;
+        for (size_t i = trim; i < count_ - trim; i++) {
+            sum += sorted[i];
+        }
+        return sum / (count_ - 2 * trim);
+    }
+};
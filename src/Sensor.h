@@ -1,13 +1,34 @@
 #pragma once
 
-#include <memory>
+#include <cstdint>
 
 #include "Measurement.h"
 
+// Home Assistant sensor entity backed by one measurement slot.
+struct SensorEntity {
+    MeasurementType type;
+    const char* object_id;
+    const char* name;
+    const char* device_class;
+    const char* unit;
+};
+
+// Common base for sensor drivers. Drivers are dispatched statically by
+// SensorSet, so the optional hooks below are plain member functions that a
+// driver simply hides when it needs them. Every driver additionally provides:
+//   static constexpr const char* name;
+//   static constexpr std::array<SensorEntity, N> entities;
+//   bool begin();
+//   ReadStatus read(uint32_t now_millis, SampleFrame& frame);
+// read() is polled on every scheduler tick once the sensor has settled, until
+// it stops returning Pending.
 class SensorDriver {
    
 public:
-    virtual ~SensorDriver() = default;
-    virtual bool begin() = 0;
-    virtual bool provideMeasurements(std::vector<std::unique_ptr<Measurement>>& measurements) = 0;
+    enum class ReadStatus { Pending, Ok, Failed };
+
+    // Brings the sensor out of sleep and returns how long it needs to settle before it can be read.
+    uint32_t wake() { return 0; }
+
+    void sleep() {}
 };
@@ -0,0 +1,284 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "AnomalyDetector.h"
+#include "SampleFilter.h"
+#include "Sensor.h"
+
+// Resumable wake -> settle -> read -> sleep state machine for a single sensor.
+// Nothing in here blocks: every call only checks deadlines against `now`.
+class SensorCycle {
+public:
+    enum class Phase { Sleeping, Settling, Reading };
+    enum class Outcome { Idle, Sampled, Failed };
+
+private:
+    static constexpr uint32_t read_timeout_millis = 5000;
+
+    Phase phase_ = Phase::Sleeping;
+    bool started_ = false;
+    uint32_t cycle_start_millis_ = 0;
+    uint32_t deadline_millis_ = 0;
+
+    static bool reached(uint32_t now, uint32_t deadline) {
+        return static_cast<int32_t>(now - deadline) >= 0;
+    }
+
+public:
+    Phase getPhase() const {
+        return phase_;
+    }
+
+    template <typename Driver>
+    Outcome advance(Driver& driver, uint32_t now, uint32_t period_millis, SampleFrame& frame) {
+        switch (phase_) {
+            case Phase::Sleeping:
+                if (started_ && !reached(now, cycle_start_millis_ + period_millis)) {
+                    return Outcome::Idle;
+                }
+                started_ = true;
+                cycle_start_millis_ = now;
+                deadline_millis_ = now + driver.wake();
+                phase_ = Phase::Settling;
+                [[fallthrough]];
+
+            case Phase::Settling:
+                if (!reached(now, deadline_millis_)) {
+                    return Outcome::Idle;
+                }
+                deadline_millis_ = now + read_timeout_millis;
+                phase_ = Phase::Reading;
+                [[fallthrough]];
+
+            case Phase::Reading: {
+                const SensorDriver::ReadStatus status = driver.read(now, frame);
+                if (status == SensorDriver::ReadStatus::Pending && !reached(now, deadline_millis_)) {
+                    return Outcome::Idle;
+                }
+
+                driver.sleep();
+                phase_ = Phase::Sleeping;
+                return status == SensorDriver::ReadStatus::Ok ? Outcome::Sampled : Outcome::Failed;
+            }
+        }
+
+        return Outcome::Idle;
+    }
+
+    // Milliseconds until this cycle needs to be advanced again.
+    uint32_t millisUntilDue(uint32_t now, uint32_t period_millis) const {
+        switch (phase_) {
+            case Phase::Sleeping:
+                if (!started_ || reached(now, cycle_start_millis_ + period_millis)) return 0;
+                return cycle_start_millis_ + period_millis - now;
+            case Phase::Settling:
+                return reached(now, deadline_millis_) ? 0 : deadline_millis_ - now;
+            default:
+                return 0;
+        }
+    }
+};
+
+struct SensorSchedule {
+    uint32_t period_millis;
+    uint8_t oversampling = 1;
+    FilterMode filter_mode = FilterMode::Median;
+};
+
+// Everything one finished read produced, handed to SensorSet::tick's callback.
+struct SensorReading {
+    size_t index;           // position of the driver in the set
+    bool health_changed;
+    SampleFrame sample;     // raw values of the read, without rejected outliers; empty if it failed
+    SampleFrame published;  // filtered values, only set when the read completed an oversampling window
+    std::array<AnomalyReport, measurement_type_count> anomalies;
+    size_t anomaly_count;
+};
+
+// Compile-time set of sensor drivers, driven from a single tick. Each sensor
+// runs its own cycle with its own sample period, so a slow one settling (e.g.
+// the PMS fan spinning up) never delays the others. Raw samples go through a
+// spike detector and a per-slot filter, and a value is only published once
+// every `oversampling` samples. Drivers are called directly on their concrete type, and a driver
+// that is not part of the set is not compiled into the firmware at all.
+template <typename... Drivers>
+class SensorSet {
+public:
+    static constexpr size_t size = sizeof...(Drivers);
+    static constexpr std::array<const char*, size> names = { Drivers::name... };
+
+private:
+    struct Slot {
+        SensorCycle cycle;
+        SensorSchedule schedule{ 0 };
+        uint8_t samples_since_publish = 0;
+        uint8_t pending_mask = 0; // types pushed into the filters since the last publish
+        bool healthy = false;
+    };
+
+    std::tuple<Drivers&...> drivers_;
+    std::array<Slot, size> slots_{};
+    std::array<SampleFilter, measurement_type_count> filters_;
+    AnomalyDetector detector_;
+
+    template <typename Driver>
+    static constexpr size_t indexOf() {
+        constexpr bool matches[] = { std::is_same_v<Driver, Drivers>... };
+        for (size_t i = 0; i < size; i++) {
+            if (matches[i]) return i;
+        }
+        return size;
+    }
+
+    SampleFrame filter(Slot& slot, const SampleFrame& sample, uint32_t now) {
+        SampleFrame filtered;
+        for (size_t index = 0; index < measurement_type_count; index++) {
+            const MeasurementType type = static_cast<MeasurementType>(index);
+            if (!sample.has(type)) continue;
+
+            SampleFilter& slot_filter = filters_[index];
+            if (slot_filter.size() == 0) {
+                slot_filter.configure(slot.schedule.oversampling, slot.schedule.filter_mode);
+            }
+            slot_filter.push(sample.get(type));
+            slot.pending_mask |= 1u << index;
+        }
+
+        if (++slot.samples_since_publish < slot.schedule.oversampling) {
+            return filtered;
+        }
+        slot.samples_since_publish = 0;
+
+        for (size_t index = 0; index < measurement_type_count; index++) {
+            if (slot.pending_mask & (1u << index)) {
+                filtered.set(static_cast<MeasurementType>(index), filters_[index].value(), now);
+            }
+        }
+        slot.pending_mask = 0;
+        return filtered;
+    }
+
+    template <size_t I, typename OnReading>
+    void tickOne(uint32_t now, OnReading& on_reading, uint32_t& next_due) {
+        auto& driver = std::get<I>(drivers_);
+        Slot& slot = slots_[I];
+
+        SensorReading reading{};
+        const SensorCycle::Outcome outcome = slot.cycle.advance(driver, now, slot.schedule.period_millis, reading.sample);
+        if (outcome != SensorCycle::Outcome::Idle) {
+            const bool ok = outcome == SensorCycle::Outcome::Sampled;
+            reading.index = I;
+            reading.health_changed = slot.healthy != ok;
+            slot.healthy = ok;
+
+            if (ok) {
+                detector_.screen(reading.sample, [&reading](const AnomalyReport& report) {
+                    reading.anomalies[reading.anomaly_count++] = report;
+                });
+                reading.published = filter(slot, reading.sample, now);
+            } else {
+                reading.sample.clear();
+            }
+            on_reading(reading);
+        }
+
+        const uint32_t due = slot.cycle.millisUntilDue(now, slot.schedule.period_millis);
+        if (due < next_due) next_due = due;
+    }
+
+    template <typename OnReading, size_t... I>
+    void tickAll(uint32_t now, OnReading& on_reading, uint32_t& next_due, std::index_sequence<I...>) {
+        (tickOne<I>(now, on_reading, next_due), ...);
+    }
+
+    template <size_t I, typename OnFailure>
+    void beginOne(OnFailure& on_failure) {
+        slots_[I].healthy = std::get<I>(drivers_).begin();
+        if (!slots_[I].healthy) {
+            on_failure(names[I]);
+        }
+    }
+
+    template <typename OnFailure, size_t... I>
+    void beginAll(OnFailure& on_failure, std::index_sequence<I...>) {
+        (beginOne<I>(on_failure), ...);
+    }
+
+public:
+    explicit SensorSet(Drivers&... drivers)
+        : drivers_(drivers...) {
+    }
+
+    template <typename Driver>
+    Driver& get() {
+        static_assert(indexOf<Driver>() < size, "Driver is not part of this sensor set");
+        return std::get<indexOf<Driver>()>(drivers_);
+    }
+
+    template <typename Driver>
+    void configure(SensorSchedule schedule) {
+        static_assert(indexOf<Driver>() < size, "Driver is not part of this sensor set");
+        if (schedule.oversampling == 0) schedule.oversampling = 1;
+        if (schedule.oversampling > SampleFilter::capacity) schedule.oversampling = SampleFilter::capacity;
+        slots_[indexOf<Driver>()].schedule = schedule;
+    }
+
+    template <typename Driver>
+    void setPeriod(uint32_t period_millis) {
+        if constexpr (indexOf<Driver>() < size) {
+            slots_[indexOf<Driver>()].schedule.period_millis = period_millis;
+        }
+    }
+
+    // Starts every driver; `on_failure(name)` is called for each one that did not come up.
+    template <typename OnFailure>
+    void begin(OnFailure&& on_failure) {
+        beginAll(on_failure, std::index_sequence_for<Drivers...>{});
+    }
+
+    bool isHealthy(size_t index) const {
+        return slots_[index].healthy;
+    }
+
+    // Writes "<name>: OK, <name>: Error, ..." into `buffer`, truncated to fit. Returns the length written.
+    size_t formatHealth(char* buffer, size_t buffer_size) const {
+        if (buffer_size == 0) return 0;
+        size_t length = 0;
+        buffer[0] = '\0';
+        for (size_t i = 0; i < size && length < buffer_size; i++) {
+            const int written = snprintf(buffer + length, buffer_size - length, "%s%s: %s",
+                                         i > 0 ? ", " : "", names[i], slots_[i].healthy ? "OK" : "Error");
+            if (written < 0) break;
+            length += static_cast<size_t>(written);
+        }
+        return length < buffer_size ? length : buffer_size - 1;
+    }
+
+    // Calls `fn(const SensorEntity&)` for every HA entity provided by the drivers in this set.
+    template <typename Fn>
+    static void forEachEntity(Fn&& fn) {
+        ([&] {
+            for (const SensorEntity& entity : Drivers::entities) fn(entity);
+        }(), ...);
+    }
+
+    AnomalyDetector& detector() {
+        return detector_;
+    }
+
+    // Advances every sensor once. `on_reading(const SensorReading&)` is called for each
+    // sensor that finished a read during this tick.
+    // Returns the milliseconds until the earliest sensor needs attention again.
+    template <typename OnReading>
+    uint32_t tick(uint32_t now, OnReading&& on_reading) {
+        uint32_t next_due = UINT32_MAX;
+        tickAll(now, on_reading, next_due, std::index_sequence_for<Drivers...>{});
+        return next_due;
+    }
+};
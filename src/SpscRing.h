@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Lock-free single-producer/single-consumer byte ring. The producer (e.g. a
+// UART event callback) writes straight into the ring storage; the consumer
+// inspects bytes in place with peek() and releases them with discard(), so
+// nothing is copied between the two sides.
+template <size_t Capacity>
+class SpscRing {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+private:
+    static constexpr size_t mask = Capacity - 1;
+
+    std::array<uint8_t, Capacity> buffer_{};
+    std::atomic<size_t> head_{0}; // only written by the producer
+    std::atomic<size_t> tail_{0}; // only written by the consumer
+    std::atomic<uint32_t> overflow_bytes_{0};
+
+public:
+    // ── Producer side ──────────────────────────────────────────
+
+    // Hands up to two contiguous free regions to `fill(uint8_t* dest, size_t max) -> size_t`
+    // and publishes whatever it wrote. Returns the number of bytes added.
+    template <typename Fill>
+    size_t fill(Fill&& fill) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        const size_t tail = tail_.load(std::memory_order_acquire);
+        size_t free_bytes = Capacity - (head - tail);
+        size_t written = 0;
+
+        while (free_bytes > 0) {
+            const size_t offset = (head + written) & mask;
+            const size_t contiguous = std::min(free_bytes, Capacity - offset);
+            const size_t n = fill(&buffer_[offset], contiguous);
+            written += n;
+            free_bytes -= n;
+            if (n < contiguous) break;
+        }
+
+        head_.store(head + written, std::memory_order_release);
+        return written;
+    }
+
+    size_t write(const uint8_t* data, size_t length) {
+        size_t consumed = 0;
+        const size_t written = fill([&](uint8_t* dest, size_t max) {
+            const size_t n = std::min(max, length - consumed);
+            for (size_t i = 0; i < n; i++) dest[i] = data[consumed + i];
+            consumed += n;
+            return n;
+        });
+        if (written < length) {
+            overflow_bytes_.fetch_add(length - written, std::memory_order_relaxed);
+        }
+        return written;
+    }
+
+    size_t available() const {
+        return Capacity - (head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_acquire));
+    }
+
+    // Copies `data` to `offset` bytes past the head without publishing it. commit()
+    // then publishes everything staged at once, so the consumer never sees half a record.
+    void stage(size_t offset, const uint8_t* data, size_t length) {
+        const size_t head = head_.load(std::memory_order_relaxed) + offset;
+        for (size_t i = 0; i < length; i++) buffer_[(head + i) & mask] = data[i];
+    }
+
+    void commit(size_t length) {
+        head_.store(head_.load(std::memory_order_relaxed) + length, std::memory_order_release);
+    }
+
+    // ── Consumer side ──────────────────────────────────────────
+
+    size_t size() const {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_relaxed);
+    }
+
+    uint8_t peek(size_t offset) const {
+        return buffer_[(tail_.load(std::memory_order_relaxed) + offset) & mask];
+    }
+
+    void read(size_t offset, uint8_t* dest, size_t length) const {
+        const size_t tail = tail_.load(std::memory_order_relaxed) + offset;
+        for (size_t i = 0; i < length; i++) dest[i] = buffer_[(tail + i) & mask];
+    }
+
+    void discard(size_t count) {
+        tail_.store(tail_.load(std::memory_order_relaxed) + std::min(count, size()), std::memory_order_release);
+    }
+
+    void clear() {
+        tail_.store(head_.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    uint32_t getOverflowBytes() const {
+        return overflow_bytes_.load(std::memory_order_relaxed);
+    }
+};
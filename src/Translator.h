@@ -35,4 +35,31 @@ public:
             default: return "";
         }
     }
-};
\ No newline at end of file
+};
+
+// Short names used for measurement types in the web API.
+class ApiNameTypeTranslator : public Translator<MeasurementType> {
+public:
+    std::string_view translate(const MeasurementType& type) const override {
+        switch (type) {
+            case MeasurementType::Temperature: return "temp";
+            case MeasurementType::Humidity: return "hum";
+            case MeasurementType::PM1: return "pm1";
+            case MeasurementType::PM25: return "pm25";
+            case MeasurementType::PM10: return "pm10";
+            case MeasurementType::CO2: return "co2";
+            default: return "";
+        }
+    }
+
+    bool tryGetTypeByName(std::string_view name, MeasurementType& type) const {
+        for (size_t index = 0; index < measurement_type_count; index++) {
+            const MeasurementType candidate = static_cast<MeasurementType>(index);
+            if (translate(candidate) == name) {
+                type = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+};
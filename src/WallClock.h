@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstdint>
+
+// Wall-clock times before this (November 2023) mean SNTP has not synced yet.
+// Anything stamped with them can't be placed in time, so it is not kept.
+static constexpr uint32_t min_valid_time = 1700000000;
@@ -1,25 +1,39 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdlib>
 #include <functional>
+#include <memory>
 #include <string>
 #include <ESPAsyncWebServer.h>
 #define WEBSERVER_H  // Prevent ArduinoOTA from pulling in conflicting WebServer
 #include <ArduinoJson.h>
 #include "ConfigManager.h"
 #include "ConfigKeys.h"
+#include "HistoryExport.h"
+#include "HistoryJsonStream.h"
+#include "HistoryLog.h"
+#include "HistoryStore.h"
 #include "Logger.h"
+#include "OnlineStats.h"
+#include "Translator.h"
 #include <Update.h>
 
 class WebConfig {
 public:
     using ConfigChangeCallback = std::function<void()>;
     using OtaCallback = std::function<void()>;
+    using StatusCallback = std::function<void(JsonObject& status)>;
 
 private:
     AsyncWebServer server_;
     ConfigChangeCallback on_config_changed_;
     OtaCallback on_ota_start_;
     OtaCallback on_ota_end_;
+    StatusCallback on_status_;
+    const HistoryStore* history_ = nullptr;
+    HistoryLog* history_log_ = nullptr;
+    const MeasurementStatistics* statistics_ = nullptr;
     bool ap_mode_ = false;
     size_t update_content_len_ = 0;
     bool should_reboot_ = false;
@@ -80,6 +94,15 @@ input:checked+.slider:before{transform:translateX(22px);background:#fff}
 <div class="field"><label>Port</label><input type="number" id="mqtt_port" min="1" max="65535"></div>
 <div class="field"><label>User</label><input type="text" id="mqtt_user"></div>
 <div class="field"><label>Password</label><input type="password" id="mqtt_pass"></div>
+<div class="field"><label>Backlog Replay Rate (msg/s)</label><input type="number" id="mqtt_replay" min="1" max="20"></div>
+<div class="field toggle">
+<label>Per-Entity State Topics</label>
+<label class="switch"><input type="checkbox" id="ha_per_entity"><span class="slider"></span></label>
+</div>
+<div class="field toggle">
+<label>Device-Based Discovery</label>
+<label class="switch"><input type="checkbox" id="ha_device_disco"><span class="slider"></span></label>
+</div>
 </div>
 
 <div class="section"><h2>Device</h2>
@@ -120,7 +143,7 @@ input:checked+.slider:before{transform:translateX(22px);background:#fff}
 </div>
 
 <script>
-const ids=['wifi_ssid','wifi_pass','mqtt_broker','mqtt_port','mqtt_user','mqtt_pass',
+const ids=['wifi_ssid','wifi_pass','mqtt_broker','mqtt_port','mqtt_user','mqtt_pass','mqtt_replay','ha_per_entity','ha_device_disco',
 'friendly_name','host_name','enable_display','display_interval','report_interval',
 'fan_speed','syslog_ip','syslog_port'];
 const rangeMap={display_interval:'rv_di',report_interval:'rv_ri',fan_speed:'rv_fs'};
@@ -271,11 +294,41 @@ function doUpload(){
         return page;
     }
 
+    static uint32_t getUintParam(AsyncWebServerRequest* request, const char* name, uint32_t fallback) {
+        if (!request->hasParam(name)) return fallback;
+        return std::strtoul(request->getParam(name)->value().c_str(), nullptr, 10);
+    }
+
+    // Streams the persistent history log as a chunked response. Records are
+    // pulled from flash while the response is being sent, one chunk at a time.
+    void sendExport(AsyncWebServerRequest* request, HistoryExport::Format format,
+                    const char* content_type, const char* file_name) {
+        if (!history_log_) {
+            request->send(503, "application/json", "{\"error\":\"History log not available\"}");
+            return;
+        }
+
+        auto history_export = std::make_shared<HistoryExport>(history_log_->read(getUintParam(request, "from", 0)), format);
+        AsyncWebServerResponse* response = request->beginChunkedResponse(content_type,
+            [history_export](uint8_t* buffer, size_t max_length, size_t /*index*/) -> size_t {
+                return history_export->fill(buffer, max_length);
+            });
+
+        char disposition[64];
+        snprintf(disposition, sizeof(disposition), "attachment; filename=\"%s\"", file_name);
+        response->addHeader("Content-Disposition", disposition);
+        request->send(response);
+    }
+
 public:
     WebConfig(uint16_t port = 80) : server_(port) {}
 
     void setOnOtaStart(OtaCallback cb) { on_ota_start_ = cb; }
     void setOnOtaEnd(OtaCallback cb) { on_ota_end_ = cb; }
+    void setOnStatus(StatusCallback cb) { on_status_ = cb; }
+    void setHistory(const HistoryStore& history) { history_ = &history; }
+    void setHistoryLog(HistoryLog& history_log) { history_log_ = &history_log; }
+    void setStatistics(const MeasurementStatistics& statistics) { statistics_ = &statistics; }
 
     void begin(ConfigChangeCallback callback = nullptr) {
         on_config_changed_ = callback;
@@ -293,6 +346,9 @@ public:
             doc[cfg::keys::mqtt_port]         = cm.getInt(cfg::keys::mqtt_port, cfg::defaults::mqtt_port);
             doc[cfg::keys::mqtt_user]         = cm.getString(cfg::keys::mqtt_user, cfg::defaults::mqtt_user);
             doc[cfg::keys::mqtt_pass]         = cm.getString(cfg::keys::mqtt_pass, cfg::defaults::mqtt_pass);
+            doc[cfg::keys::mqtt_replay_rate]  = cm.getInt(cfg::keys::mqtt_replay_rate, cfg::defaults::mqtt_replay_rate);
+            doc[cfg::keys::ha_per_entity_topics] = cm.getBool(cfg::keys::ha_per_entity_topics, cfg::defaults::ha_per_entity_topics) ? "1" : "0";
+            doc[cfg::keys::ha_device_discovery] = cm.getBool(cfg::keys::ha_device_discovery, cfg::defaults::ha_device_discovery) ? "1" : "0";
             doc[cfg::keys::friendly_name]     = cm.getString(cfg::keys::friendly_name, cfg::defaults::friendly_name);
             doc[cfg::keys::host_name]         = cm.getString(cfg::keys::host_name, cfg::defaults::host_name);
             doc[cfg::keys::enable_display]    = cm.getBool(cfg::keys::enable_display, cfg::defaults::enable_display) ? "1" : "0";
@@ -302,9 +358,9 @@ public:
             doc[cfg::keys::syslog_server_ip]  = cm.getString(cfg::keys::syslog_server_ip, cfg::defaults::syslog_server_ip);
             doc[cfg::keys::syslog_server_port] = cm.getInt(cfg::keys::syslog_server_port, cfg::defaults::syslog_server_port);
 
-            std::string output;
-            serializeJson(doc, output);
-            request->send(200, "application/json", output.c_str());
+            AsyncResponseStream* response = request->beginResponseStream("application/json");
+            serializeJson(doc, *response);
+            request->send(response);
         });
 
         server_.on("/api/config", HTTP_POST,
@@ -341,6 +397,7 @@ public:
                 putIntFromStr(cfg::keys::mqtt_port, 1, 65535);
                 putStr(cfg::keys::mqtt_user);
                 putStr(cfg::keys::mqtt_pass);
+                putIntFromStr(cfg::keys::mqtt_replay_rate, 1, 20);
                 putStr(cfg::keys::friendly_name);
                 putStr(cfg::keys::host_name);
                 putStr(cfg::keys::syslog_server_ip);
@@ -350,6 +407,14 @@ public:
                     std::string val = doc[cfg::keys::enable_display].as<std::string>();
                     cm.putBool(cfg::keys::enable_display, val == "1" || val == "true");
                 }
+                if (doc.containsKey(cfg::keys::ha_per_entity_topics)) {
+                    std::string val = doc[cfg::keys::ha_per_entity_topics].as<std::string>();
+                    cm.putBool(cfg::keys::ha_per_entity_topics, val == "1" || val == "true");
+                }
+                if (doc.containsKey(cfg::keys::ha_device_discovery)) {
+                    std::string val = doc[cfg::keys::ha_device_discovery].as<std::string>();
+                    cm.putBool(cfg::keys::ha_device_discovery, val == "1" || val == "true");
+                }
                 putIntFromStr(cfg::keys::display_interval, 5, 15);
                 putIntFromStr(cfg::keys::report_interval, 1, 15);
                 putIntFromStr(cfg::keys::fan_speed, 0, 100);
@@ -367,8 +432,8 @@ public:
         });
 
         // ── Status Endpoint ──
-        server_.on("/api/status", HTTP_GET, [](AsyncWebServerRequest* request) {
-            StaticJsonDocument<256> doc;
+        server_.on("/api/status", HTTP_GET, [this](AsyncWebServerRequest* request) {
+            StaticJsonDocument<1536> doc;
             doc["uptime_s"] = millis() / 1000;
             doc["free_heap"] = ESP.getFreeHeap();
             doc["wifi_rssi"] = WiFi.RSSI();
@@ -376,9 +441,95 @@ public:
             doc["ip"] = WiFi.localIP().toString();
             doc["mac"] = WiFi.macAddress();
 
-            std::string json;
-            serializeJson(doc, json);
-            request->send(200, "application/json", json.c_str());
+            if (on_status_) {
+                JsonObject status = doc.as<JsonObject>();
+                on_status_(status);
+            }
+
+            AsyncResponseStream* response = request->beginResponseStream("application/json");
+            serializeJson(doc, *response);
+            request->send(response);
+        });
+
+        // ── Statistics Endpoint ──
+        server_.on("/api/stats", HTTP_GET, [this](AsyncWebServerRequest* request) {
+            if (!statistics_) {
+                request->send(503, "application/json", "{\"error\":\"Statistics not available\"}");
+                return;
+            }
+
+            StaticJsonDocument<1536> doc;
+            for (size_t index = 0; index < measurement_type_count; index++) {
+                const MeasurementType type = static_cast<MeasurementType>(index);
+                if (!statistics_->has(type)) continue;
+
+                const StatsSummary summary = statistics_->summary(type);
+                JsonObject stats = doc.createNestedObject(ApiNameTypeTranslator().translate(type));
+                stats["samples"] = summary.count;
+                stats["last"] = summary.last;
+                stats["ewma"] = summary.ewma;
+                stats["mean"] = summary.mean;
+                stats["stddev"] = summary.stddev;
+                stats["p50"] = summary.p50;
+                stats["p95"] = summary.p95;
+            }
+
+            AsyncResponseStream* response = request->beginResponseStream("application/json");
+            serializeJson(doc, *response);
+            request->send(response);
+        });
+
+        // ── History Endpoint ──
+        // GET /api/history?type=co2&from=<epoch s>&res=raw|1m|15m&points=<max points>
+        server_.on("/api/history", HTTP_GET, [this](AsyncWebServerRequest* request) {
+            if (!history_) {
+                request->send(503, "application/json", "{\"error\":\"History not available\"}");
+                return;
+            }
+
+            MeasurementType type;
+            if (!request->hasParam("type") ||
+                !ApiNameTypeTranslator().tryGetTypeByName(request->getParam("type")->value().c_str(), type)) {
+                request->send(400, "application/json", "{\"error\":\"Unknown type\"}");
+                return;
+            }
+
+            HistoryResolution resolution = HistoryResolution::OneMinute;
+            const char* resolution_name = "1m";
+            if (request->hasParam("res")) {
+                const String& res = request->getParam("res")->value();
+                if (res == "raw") {
+                    resolution = HistoryResolution::Raw;
+                    resolution_name = "raw";
+                } else if (res == "15m") {
+                    resolution = HistoryResolution::FifteenMinutes;
+                    resolution_name = "15m";
+                } else if (res != "1m") {
+                    request->send(400, "application/json", "{\"error\":\"Unknown resolution\"}");
+                    return;
+                }
+            }
+
+            const uint32_t from = getUintParam(request, "from", 0);
+            const uint32_t points = getUintParam(request, "points", 0);
+
+            // Streamed in chunks: the store lock is taken per batch of points, never while sending.
+            auto stream = std::make_shared<HistoryJsonStream>(*history_, type, resolution, resolution_name, from, points);
+            AsyncWebServerResponse* response = request->beginChunkedResponse("application/json",
+                [stream](uint8_t* buffer, size_t max_length, size_t /*index*/) -> size_t {
+                    return stream->fill(buffer, max_length);
+                });
+            request->send(response);
+        });
+
+        // ── Export Endpoints ──
+        // GET /api/export.csv?from=<epoch s>, GET /api/export.ndjson?from=<epoch s>
+        server_.on("/api/export.csv", HTTP_GET, [this](AsyncWebServerRequest* request) {
+            sendExport(request, HistoryExport::Format::Csv, "text/csv", "history.csv");
+        });
+
+        server_.on("/api/export.ndjson", HTTP_GET, [this](AsyncWebServerRequest* request) {
+            sendExport(request, HistoryExport::Format::NdJson, "application/x-ndjson", "history.ndjson");
         });
 
         // ── Firmware Update Page ──
@@ -17,6 +17,20 @@ protected:
     const std::string discovery_prefix_;
     const std::string device_id_;
     const std::string base_topic_;
+    std::string entity_state_base_; // empty unless each state field has its own topic
+
+    // Points `topic_key` at the state field `key`. With per-entity topics that is
+    // "<base>/<key>" carrying the bare value, otherwise the shared state topic plus
+    // a `template_key` that picks the field out of the JSON document.
+    void addStateField(JsonObject& doc, const char* topic_key, const char* template_key,
+                       const std::string& key, std::string_view filter = "") const {
+        if (!entity_state_base_.empty()) {
+            doc[topic_key] = entity_state_base_ + "/" + key;
+            return;
+        }
+        doc[topic_key] = getStateTopic();
+        doc[template_key] = "{{ value_json." + key + std::string{filter} + " }}";
+    }
 
 public:
     Component(const Device& device,
@@ -48,22 +62,34 @@ public:
     virtual std::vector<std::string> getCommandTopics() const { return {}; }
     virtual std::string getStatePayload() const { return ""; }
 
-    virtual StaticJsonDocument<1024> getDiscoveryPayload(const Device& device) const {
-        StaticJsonDocument<1024> doc;
+    // Device and availability fields. A single-entity config carries them itself,
+    // a device-based config writes them once for all of its components.
+    static void populateDeviceDiscovery(JsonObject& doc, const Device& device) {
         doc["dev"] = device.getDeviceInfoJson();
-        doc["name"] = friendly_name_;
-        doc["uniq_id"] = unique_id_;
-        doc["stat_t"] = getStateTopic();
         doc["avty_t"] = std::string{device.getAvailabilityTopic()};
         doc["pl_avail"] = std::string{device.getAvailabilityPayloadOnline()};
         doc["pl_not_avail"] = std::string{device.getAvailabilityPayloadOffline()};
-        return doc;
+    }
+
+    // Fills in the entity's own discovery fields. The manager serializes the configs
+    // once, before the first discovery, so everything that shapes them must be set up
+    // by the time the component is added.
+    virtual void populateDiscovery(JsonObject& doc) const {
+        doc["name"] = friendly_name_;
+        doc["uniq_id"] = unique_id_;
+        doc["stat_t"] = getStateTopic();
+    }
+
+    // Switches discovery to per-entity state topics under `base`. Set by the manager before populateDiscovery().
+    void setEntityStateBase(std::string_view base) {
+        entity_state_base_ = std::string{base};
     }
 
     std::string_view getObjectId() const { return object_id_; }
     std::string_view getComponentType() const { return component_type_; }
 
-    virtual void handleCommand(const std::string& topic, const std::string& payload) {}
+    // `payload` points into the client's receive buffer and is only valid during the call.
+    virtual void handleCommand(std::string_view /*topic*/, std::string_view /*payload*/) {}
 
     virtual void populateState(JsonObject& doc) const {
         std::string state = getStatePayload();
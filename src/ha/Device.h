@@ -56,6 +56,14 @@ public:
     std::string_view getMacId() const {
         return mac_id_;
     }
+
+    std::string_view getDeviceName() const {
+        return device_name_;
+    }
+
+    std::string_view getSoftwareVersion() const {
+        return software_version_;
+    }
     
 private:
     const std::string availability_topic_;
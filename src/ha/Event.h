@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include "Component.h"
+
+namespace ha {
+
+// Stateless HA event entity. Events go to their own topic and are never part
+// of the shared state document, so a state report can't replay them.
+class Event : public Component {
+private:
+    const std::string event_topic_;
+    const std::vector<std::string> event_types_;
+
+public:
+    Event(const Device& device,
+            std::string_view object_id,
+            std::string_view friendly_name,
+            std::vector<std::string> event_types,
+            std::string_view discovery_prefix = "homeassistant")
+        : Component(device, "event", object_id, friendly_name, discovery_prefix)
+        , event_topic_(base_topic_ + "/event")
+        , event_types_(std::move(event_types))
+    {
+    }
+
+    std::string getStateTopic() const override {
+        return event_topic_;
+    }
+
+    void populateDiscovery(JsonObject& doc) const override {
+        Component::populateDiscovery(doc);
+        JsonArray types = doc.createNestedArray("evt_typ");
+        for (const auto& type : event_types_) {
+            types.add(type);
+        }
+    }
+
+    void populateState(JsonObject& /*doc*/) const override {}
+};
+
+} // namespace ha
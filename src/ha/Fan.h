@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Component.h"
+#include <charconv>
 #include <functional>
 
 namespace ha {
@@ -32,18 +33,16 @@ public:
     {
     }
 
-    StaticJsonDocument<1024> getDiscoveryPayload(const Device& device) const override {
-        StaticJsonDocument<1024> doc = Component::getDiscoveryPayload(device);
+    void populateDiscovery(JsonObject& doc) const override {
+        Component::populateDiscovery(doc);
         doc["cmd_t"] = command_topic_;
         doc["pct_cmd_t"] = percentage_command_topic_;
         doc["payload_on"] = "ON";
         doc["payload_off"] = "OFF";
-        doc["pct_stat_t"] = getStateTopic();
-        doc["stat_val_tpl"] = "{{ value_json." + state_key_ + " }}";
-        doc["pct_val_tpl"] = "{{ value_json." + speed_key_ + " }}";
+        addStateField(doc, "stat_t", "stat_val_tpl", state_key_);
+        addStateField(doc, "pct_stat_t", "pct_val_tpl", speed_key_);
         doc["spd_rng_min"] = 1;
         doc["spd_rng_max"] = 100;
-        return doc;
     }
 
     std::string getCommandTopic() const override {
@@ -62,16 +61,14 @@ public:
         return percentage_command_topic_;
     }
 
-    void handleCommand(const std::string& topic, const std::string& payload) override {
+    void handleCommand(std::string_view topic, std::string_view payload) override {
         if (topic == command_topic_) {
             bool new_state = (payload == "ON");
             updateState(new_state);
             if (on_off_callback_) on_off_callback_(new_state);
         } else if (topic == percentage_command_topic_) {
-            if (payload.empty()) return;
-            char* end = nullptr;
-            long speed = std::strtol(payload.c_str(), &end, 10);
-            if (end == payload.c_str()) return; // Parse failed
+            long speed = 0;
+            if (std::from_chars(payload.data(), payload.data() + payload.size(), speed).ec != std::errc()) return; // Parse failed
             if (speed < 0) speed = 0;
             if (speed > 100) speed = 100;
             updateSpeed(static_cast<uint8_t>(speed));
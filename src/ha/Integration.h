@@ -6,17 +6,23 @@
 #include <vector>
 
 #include <array>
+#include <cmath>
 #include <mutex>
 #include "MqttClient.h"
 #include "Manager.h"
 #include "StateReporter.h"
+#include "Event.h"
 #include "Fan.h"
 #include "Switch.h"
 #include "Number.h"
 #include "Sensor.h"
+#include "../AnomalyDetector.h"
+#include "../AqiEngine.h"
 #include "../Measurement.h"
+#include "../OnlineStats.h"
 #include "../Logger.h"
 #include "../ConfigKeys.h"
+#include "../Translator.h"
 
 namespace ha {
 
@@ -34,12 +40,39 @@ public:
         , discovery_prefix_{discovery_prefix} {
         manager_ = std::make_shared<ha::Manager>(device_, mqtt_client);
         state_reporter_ = std::make_unique<ha::StateReporter>(device_, mqtt_client_, manager_);
+        manager_->setDiscoveryPrefix(discovery_prefix_);
+        manager_->setDiscoveryModeCallback([this](bool device_discovery) {
+            if (config_save_cb_) config_save_cb_(cfg::keys::ha_device_discovery_active, device_discovery);
+        });
     }
 
     void begin() {
         setupControls();
     }
 
+    // Must be called before begin(); it shapes the discovery configs.
+    void setPerEntityStateTopics(bool enabled) {
+        manager_->setPerEntityStateTopics(enabled);
+    }
+
+    // Must be called before begin(). Sends one config for the whole device instead of one per entity.
+    // `on_broker` is the last mode saved under cfg::keys::ha_device_discovery_active.
+    void setDeviceDiscovery(bool enabled, bool on_broker) {
+        manager_->setDeviceDiscovery(enabled, on_broker);
+    }
+
+    uint32_t getStateBytesSent() const {
+        return manager_->getStateBytesSent();
+    }
+
+    uint32_t getStatePublishCount() const {
+        return manager_->getStatePublishCount();
+    }
+
+    StateReporter::Stats getReportStats() const {
+        return state_reporter_->getStats();
+    }
+
     void setFanCallback(FanCallback cb) {
         fan_cb_ = cb;
     }
@@ -62,20 +95,21 @@ public:
         if (!manager_) return;
         
         auto sensor = std::make_shared<ha::Sensor>(*device_, object_id, name, device_class, unit, discovery_prefix_);
+        sensor->enableAttributes();
         manager_->addComponent(sensor);
         sensors_[static_cast<size_t>(type)] = sensor;
     }
     
-    void report(const std::vector<std::unique_ptr<Measurement>>& measurements) {
+    void report(const SampleFrame& measurements) {
         std::lock_guard<std::mutex> lock(integration_mutex_);
         bool updated = false;
-        for (const auto& measurement : measurements) {
-            MeasurementType type = measurement->getDetails().getType();
-            size_t idx = static_cast<size_t>(type);
-            
-            if (idx >= kMeasurementTypeCount || !sensors_[idx]) continue;
+        for (size_t idx = 0; idx < measurement_type_count; idx++) {
+            const MeasurementType type = static_cast<MeasurementType>(idx);
+            if (!measurements.has(type) || !sensors_[idx]) continue;
 
-            sensors_[idx]->updateState(measurement->valueToString());
+            char value[16];
+            const size_t length = measurements.formatValue(type, value, sizeof(value));
+            sensors_[idx]->updateState(std::string_view(value, length));
             updated = true;
         }
 
@@ -84,16 +118,96 @@ public:
         }
     }
 
+    // Attaches the running statistics to the measurement sensors as HA attributes.
+    // They go out with the next state report.
+    void reportStatistics(const MeasurementStatistics& statistics) {
+        std::lock_guard<std::mutex> lock(integration_mutex_);
+        for (size_t idx = 0; idx < measurement_type_count; idx++) {
+            const MeasurementType type = static_cast<MeasurementType>(idx);
+            if (!sensors_[idx] || !statistics.has(type)) continue;
+
+            const StatsSummary summary = statistics.summary(type);
+            sensors_[idx]->updateAttribute("ewma", roundForReport(summary.ewma));
+            sensors_[idx]->updateAttribute("mean", roundForReport(summary.mean));
+            sensors_[idx]->updateAttribute("stddev", roundForReport(summary.stddev));
+            sensors_[idx]->updateAttribute("p50", roundForReport(summary.p50));
+            sensors_[idx]->updateAttribute("p95", roundForReport(summary.p95));
+            sensors_[idx]->updateAttribute("samples", summary.count);
+        }
+    }
+
+    void reportAqi(const AqiSummary& summary) {
+        std::lock_guard<std::mutex> lock(integration_mutex_);
+        if (!aqi_sensor_) return;
+        if (!summary.valid) {
+            // Home Assistant shows "None" as unknown, rather than keeping the last index.
+            if (aqi_sensor_->updateState("None")) state_reporter_->requestReport();
+            return;
+        }
+
+        char value[8];
+        snprintf(value, sizeof(value), "%u", summary.aqi);
+        aqi_sensor_->updateState(value);
+        aqi_sensor_->updateAttribute("nowcast_pm25", summary.nowcast_pm25);
+        aqi_sensor_->updateAttribute("nowcast_pm10", summary.nowcast_pm10);
+        aqi_sensor_->updateAttribute("aqi_pm25", summary.aqi_pm25);
+        aqi_sensor_->updateAttribute("aqi_pm10", summary.aqi_pm10);
+        aqi_sensor_->updateAttribute("caqi", summary.caqi);
+        aqi_sensor_->updateAttribute("avg24_pm25", roundForReport(summary.average_pm25));
+        aqi_sensor_->updateAttribute("avg24_pm10", roundForReport(summary.average_pm10));
+        state_reporter_->requestReport();
+    }
+
+    // Queues an anomaly event; it is published from loop(), never from the caller's task.
+    void reportAnomaly(const AnomalyReport& report) {
+        std::lock_guard<std::mutex> lock(integration_mutex_);
+        pending_anomalies_[(anomaly_head_ + anomaly_count_) % pending_anomalies_.size()] = report;
+        if (anomaly_count_ < pending_anomalies_.size()) {
+            anomaly_count_++;
+        } else {
+            anomaly_head_ = (anomaly_head_ + 1) % pending_anomalies_.size();
+        }
+    }
+
+    void setReplayRate(uint32_t messages_per_second) {
+        manager_->setReplayRate(messages_per_second);
+    }
+
+    uint32_t getLastDiscoveryMillis() const {
+        return manager_->getLastDiscoveryMillis();
+    }
+
+    Manager::BacklogStats getBacklogStats() const {
+        return manager_->getBacklogStats();
+    }
+
+    // Backlog depth as a diagnostic sensor, drops and drain latency as its attributes.
+    // Called on its own timer, so it requests a report itself when anything changed.
+    void reportBacklog() {
+        std::lock_guard<std::mutex> lock(integration_mutex_);
+        if (!backlog_sensor_) return;
+
+        const Manager::BacklogStats stats = manager_->getBacklogStats();
+        char value[12];
+        snprintf(value, sizeof(value), "%u", static_cast<unsigned>(stats.depth));
+        bool changed = backlog_sensor_->updateState(value);
+        changed |= backlog_sensor_->updateAttribute("dropped", stats.dropped);
+        changed |= backlog_sensor_->updateAttribute("replayed", stats.replayed);
+        changed |= backlog_sensor_->updateAttribute("drain_latency_ms", stats.last_drain_latency_ms);
+        changed |= backlog_sensor_->updateAttribute("max_drain_latency_ms", stats.max_drain_latency_ms);
+        if (changed) state_reporter_->requestReport();
+    }
+
     void updateSensorHealth(std::string_view health_status) {
         std::lock_guard<std::mutex> lock(integration_mutex_);
-        if (health_sensor_) {
-            health_sensor_->updateState(health_status);
+        if (health_sensor_ && health_sensor_->updateState(health_status)) {
             state_reporter_->requestReport();
         }
     }
 
     void loop() {
         state_reporter_->loop();
+        publishAnomalies();
     }
 
     void syncState(bool display_enabled, uint32_t display_interval_ms, 
@@ -108,14 +222,14 @@ public:
             fan_->updateSpeed(fan_speed);
         }
         
-        state_reporter_->forceReport();
+        state_reporter_->requestReport(ReportPriority::Control);
     }
     
     void updateIpAddress(std::string_view ip) {
         std::lock_guard<std::mutex> lock(integration_mutex_);
         if (ip_sensor_) {
             ip_sensor_->updateState(ip);
-            state_reporter_->forceReport();
+            state_reporter_->requestReport();
         }
     }
 
@@ -141,9 +255,16 @@ private:
     std::shared_ptr<ha::Number> report_interval_;
     std::shared_ptr<ha::Sensor> ip_sensor_;
     std::shared_ptr<ha::Sensor> health_sensor_;
+    std::shared_ptr<ha::Sensor> aqi_sensor_;
+    std::shared_ptr<ha::Sensor> backlog_sensor_;
+    std::shared_ptr<ha::Event> anomaly_event_;
+    std::shared_ptr<ha::Event> backfill_event_;
+
+    std::array<AnomalyReport, 8> pending_anomalies_{};
+    size_t anomaly_head_ = 0;
+    size_t anomaly_count_ = 0;
 
-    static constexpr size_t kMeasurementTypeCount = 6;
-    std::array<std::shared_ptr<ha::Sensor>, kMeasurementTypeCount> sensors_{};
+    std::array<std::shared_ptr<ha::Sensor>, measurement_type_count> sensors_{};
 
     FanCallback fan_cb_;
     DisplayCallback display_cb_;
@@ -153,6 +274,28 @@ private:
     
     mutable std::mutex integration_mutex_;
 
+    void publishAnomalies() {
+        std::lock_guard<std::mutex> lock(integration_mutex_);
+        while (anomaly_count_ > 0 && anomaly_event_ && mqtt_client_->isConnected()) {
+            const AnomalyReport& report = pending_anomalies_[anomaly_head_];
+            const std::string_view type = ApiNameTypeTranslator().translate(report.type);
+
+            char payload[160];
+            snprintf(payload, sizeof(payload),
+                     "{\"event_type\":\"spike\",\"type\":\"%.*s\",\"value\":%.2f,\"median\":%.2f,\"score\":%.1f,\"rejected\":%s}",
+                     static_cast<int>(type.size()), type.data(), report.value, report.median, report.score,
+                     report.rejected ? "true" : "false");
+            if (!mqtt_client_->publish(anomaly_event_->getStateTopic(), payload, false)) break;
+
+            anomaly_head_ = (anomaly_head_ + 1) % pending_anomalies_.size();
+            anomaly_count_--;
+        }
+    }
+
+    static double roundForReport(double value) {
+        return std::round(value * 100.0) / 100.0;
+    }
+
     void setupControls() {
         if (!manager_) return;
         
@@ -165,7 +308,7 @@ private:
                 Logger::getInstance().log(Logger::Level::Info, "Display %s via MQTT", state ? "enabled" : "disabled");
                 
                 if (display_switch_) display_switch_->updateState(state);
-                state_reporter_->forceReport();
+                state_reporter_->requestReport(ReportPriority::Control);
             });
         manager_->addComponent(display_switch_);
 
@@ -175,7 +318,7 @@ private:
                 if (config_save_cb_) config_save_cb_(cfg::keys::display_interval, (int)val);
                 
                 Logger::getInstance().log(Logger::Level::Info, "Display interval: %.1fs", val);
-                state_reporter_->forceReport();
+                state_reporter_->requestReport(ReportPriority::Control);
             });
         manager_->addComponent(display_interval_);
 
@@ -185,7 +328,7 @@ private:
                 if (config_save_cb_) config_save_cb_(cfg::keys::report_interval, (int)val);
                 
                 Logger::getInstance().log(Logger::Level::Info, "Report interval: %.1fm", val);
-                state_reporter_->forceReport();
+                state_reporter_->requestReport(ReportPriority::Control);
             });
         manager_->addComponent(report_interval_);
 
@@ -193,9 +336,11 @@ private:
         fan_ = std::make_shared<ha::Fan>(*device_, "fan", "Fan",
             [this](bool state) {
                 if (fan_cb_) fan_cb_(state, 0);
+                state_reporter_->requestReport(ReportPriority::Control);
             },
             [this](uint8_t speed) {
                 if (fan_cb_) fan_cb_(true, speed);
+                state_reporter_->requestReport(ReportPriority::Control);
             });
         manager_->addComponent(fan_);
 
@@ -208,6 +353,29 @@ private:
         health_sensor_ = std::make_shared<ha::Sensor>(*device_, "sensor_health", "Sensor Health",
             "", "", discovery_prefix_, "diagnostic", "mdi:heart-pulse");
         manager_->addComponent(health_sensor_);
+
+        // States waiting to be replayed after an MQTT outage
+        backlog_sensor_ = std::make_shared<ha::Sensor>(*device_, "mqtt_backlog", "MQTT Backlog",
+            "", "", discovery_prefix_, "diagnostic", "mdi:tray-full");
+        backlog_sensor_->enableAttributes();
+        manager_->addComponent(backlog_sensor_);
+
+        // US EPA AQI from the NowCast PM values, CAQI and 24 h means as attributes
+        aqi_sensor_ = std::make_shared<ha::Sensor>(*device_, "aqi", "Air Quality Index",
+            "aqi", "", discovery_prefix_);
+        aqi_sensor_->enableAttributes();
+        manager_->addComponent(aqi_sensor_);
+
+        // Spikes caught by the anomaly detector
+        anomaly_event_ = std::make_shared<ha::Event>(*device_, "anomaly", "Sensor Anomaly",
+            std::vector<std::string>{ "spike" }, discovery_prefix_);
+        manager_->addComponent(anomaly_event_);
+
+        // States snapshotted during an MQTT outage, replayed with the time they were taken
+        backfill_event_ = std::make_shared<ha::Event>(*device_, "state_backfill", "State Backfill",
+            std::vector<std::string>{ "snapshot" }, discovery_prefix_);
+        manager_->addComponent(backfill_event_);
+        manager_->setReplayTopic(backfill_event_->getStateTopic());
     }
 };
 
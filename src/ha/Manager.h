@@ -1,27 +1,134 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <functional>
 #include <vector>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <ctime>
 #include "MqttClient.h"
 #include "Device.h"
 #include "Component.h"
 #include "Switch.h"
 #include "Fan.h"
+#include "OutboundQueue.h"
+#include "../Logger.h"
+#include "../WallClock.h"
 
 namespace ha {
 
 class Manager {
+public:
+    using BacklogStats = OutboundQueue<12288>::Stats;
+
+    // Discovery goes out one config per tick, within a byte budget that refills at
+    // discovery_bytes_per_second, so a reconnect doesn't flood the socket. A failed
+    // publish is retried on a later tick; configs already sent are not repeated
+    // unless the connection drops before the client has flushed them.
+    static constexpr uint32_t discovery_bytes_per_second = 4096;
+
 private:
+    // One snapshot per minute while offline; about 40 minutes of state fit the backlog.
+    static constexpr uint32_t backlog_interval_ms = 60000;
+
     std::shared_ptr<Device> device_;
     std::shared_ptr<MqttClient> mqtt_client_;
     std::vector<std::shared_ptr<Component>> components_;
-    
+
+    // Discovery configs, serialized once before the first discovery. A deque never
+    // moves its elements, so the payloads can be handed to the client by reference.
+    // `sent` means queued with the client in the current round; a round only counts
+    // once the client has flushed it, and starts over if the connection drops first.
+    // `once` messages are not repeated by restartDiscovery() after such a round.
+    struct DiscoveryMessage {
+        std::string topic;
+        std::string payload;
+        bool sent = false;
+        bool once = false;
+    };
+    std::deque<DiscoveryMessage> discovery_cache_;
+
+    // Device-based discovery sends one config for the whole device to
+    // "<prefix>/device/<device id>/config", with the device and availability
+    // fields once and every entity under "cmps", instead of one config per entity.
+    // The broker keeps the configs of whichever mode was published last; switching
+    // modes migrates the entities once, see buildDiscoveryCache().
+    static constexpr size_t device_discovery_capacity = 12288;
+    bool device_discovery_ = false;
+    bool device_discovery_on_broker_ = false;
+    bool discovery_mode_switch_ = false;
+    std::function<void(bool device_discovery)> discovery_mode_cb_;
+    std::string discovery_prefix_;
+
+    // Discovery pacing, see discovery_bytes_per_second.
+    size_t discovery_next_ = 0;
+    uint32_t discovery_budget_ = 0;
+    uint32_t discovery_budget_time_ = 0;
+    uint32_t discovery_started_ = 0;
+    bool discovery_running_ = false;
+    uint32_t last_discovery_millis_ = 0;
+
+    // Command topic → component, open addressing on an FNV-1a hash with linear
+    // probing. Filled by addComponent(); a lookup hashes the topic once and
+    // usually compares a single string.
+    struct CommandRoute {
+        uint32_t hash = 0;
+        std::string topic;
+        Component* component = nullptr;
+    };
+    static constexpr size_t command_table_size = 16; // power of two, keep it at least twice the command topics
+    std::array<CommandRoute, command_table_size> command_routes_{};
+    size_t command_route_count_ = 0;
+
+    // State publishing. Shared mode sends the whole document to one topic, but
+    // only when it differs from the last one sent. Per-entity mode sends each
+    // top-level field to "<device id>/<field>" and only the fields that changed.
+    std::string entity_state_base_;
+    struct PublishedField {
+        uint32_t key_hash;
+        uint32_t value_hash;
+    };
+    std::vector<PublishedField> published_fields_;
+    uint32_t published_state_hash_ = 0;
+    uint32_t state_bytes_sent_ = 0;
+    uint32_t state_publishes_ = 0;
+
     bool discovery_published_ = false;
+    bool was_connected_ = false;
+    uint32_t connection_count_ = 0;
+
+    // Home Assistant announces itself here after it starts, and loses the discovered
+    // entities with a restart; that and the first connect after boot are the only
+    // times discovery needs to go out.
+    std::string birth_topic_;
+    static constexpr std::string_view birth_payload_online = "online";
+    static constexpr std::string_view migrate_payload = "{\"migrate_discovery\":true}";
     uint32_t last_report_time_ = 0;
     const uint32_t report_interval_ = 30000; // 30 seconds
+
+    // States that could not be sent while the broker was unreachable. Home Assistant
+    // stamps MQTT states with their arrival time, so replaying them to the live
+    // entities would only make those jump back to old values. They are replayed as
+    // events of an event entity instead, which HA records with the snapshot's `ts`
+    // and values as attributes. Nothing is queued until setReplayTopic() was called.
+    std::string replay_topic_;
+    OutboundQueue<12288> backlog_;
+    uint32_t last_backlog_time_ = 0;
+    uint32_t last_replay_time_ = 0;
+    uint32_t replay_interval_ms_ = 500;
     
+    // State documents, kept here instead of on the caller's (loop task) stack and only
+    // used with manager_mutex_ held. With every sensor and attribute populated the state
+    // has 70 fields, 1120 B of slots on the ESP32, plus up to about 450 B of copied keys
+    // and strings. The backlog snapshot keeps the 15 scalar fields, the event type and a timestamp.
+    static constexpr size_t state_json_capacity = 2048;
+    static constexpr size_t snapshot_json_capacity = 768;
+    StaticJsonDocument<state_json_capacity> state_json_;
+    StaticJsonDocument<snapshot_json_capacity> snapshot_json_;
+
     mutable std::recursive_mutex manager_mutex_;
 
 public:
@@ -31,72 +138,396 @@ public:
         , mqtt_client_(mqtt_client) {
         
         mqtt_client_->setCallback([this](std::string_view topic, const uint8_t* payload, size_t length) {
-            std::string payload_str = (payload && length > 0) ? std::string((const char*)payload, length) : "";
-            
+            const std::string_view payload_view(payload ? reinterpret_cast<const char*>(payload) : "", payload ? length : 0);
+
             std::lock_guard<std::recursive_mutex> lock(manager_mutex_);
-            for (auto& comp : components_) {
-                for (const auto& cmd_topic : comp->getCommandTopics()) {
-                    if (cmd_topic == topic) {
-                        comp->handleCommand(cmd_topic, payload_str);
-                    }
+            if (!birth_topic_.empty() && topic == birth_topic_) {
+                if (payload_view == birth_payload_online) {
+                    Logger::getInstance().log(Logger::Level::Info, "HA: Home Assistant came online, republishing discovery");
+                    restartDiscovery();
                 }
+                return;
+            }
+            if (Component* component = findCommandHandler(topic)) {
+                component->handleCommand(topic, payload_view);
             }
         });
     }
 
+    // Discovery topics live under `prefix`, and Home Assistant's status under "<prefix>/status".
+    void setDiscoveryPrefix(std::string_view prefix) {
+        std::lock_guard<std::recursive_mutex> lock(manager_mutex_);
+        discovery_prefix_ = std::string{prefix};
+        birth_topic_ = discovery_prefix_ + "/status";
+        mqtt_client_->subscribe(birth_topic_);
+    }
+
+    // Must be called before the first discovery; the configs are built only once.
+    // `on_broker` is the mode the broker was last left with, as reported to the
+    // discovery mode callback.
+    void setDeviceDiscovery(bool enabled, bool on_broker) {
+        std::lock_guard<std::recursive_mutex> lock(manager_mutex_);
+        device_discovery_ = enabled;
+        device_discovery_on_broker_ = on_broker;
+    }
+
+    // Called once a switch between per-entity and device discovery has been flushed to
+    // the broker, to persist the new mode. Until then a reconnect repeats the migration.
+    void setDiscoveryModeCallback(std::function<void(bool device_discovery)> cb) {
+        std::lock_guard<std::recursive_mutex> lock(manager_mutex_);
+        discovery_mode_cb_ = cb;
+    }
+
     void addComponent(std::shared_ptr<Component> component) {
         std::lock_guard<std::recursive_mutex> lock(manager_mutex_);
         components_.push_back(component);
+        if (!entity_state_base_.empty()) component->setEntityStateBase(entity_state_base_);
+
         for (const auto& topic : component->getCommandTopics()) {
             if (!topic.empty()) {
+                addCommandRoute(topic, component.get());
                 mqtt_client_->subscribe(topic);
             }
         }
     }
 
-    void publishDiscovery(bool force = false) {
+    // Starts sending every discovery config again from the first one. The migration
+    // messages of a mode switch are repeated too until a round has been flushed.
+    void restartDiscovery() {
         std::lock_guard<std::recursive_mutex> lock(manager_mutex_);
-        if (discovery_published_ && !force) return;
-        
-        bool all_published = true;
-        for (const auto& comp : components_) {
-            auto doc = comp->getDiscoveryPayload(*device_);
-            std::string payload;
-            serializeJson(doc, payload);
-            if (!mqtt_client_->publish(comp->getDiscoveryTopic().c_str(), payload.c_str(), true)) {
-                all_published = false;
-            }
+        for (auto& message : discovery_cache_) {
+            if (!message.once || discovery_mode_switch_) message.sent = false;
         }
-        discovery_published_ = all_published;
+        discovery_next_ = 0;
+        discovery_running_ = false;
+        discovery_published_ = false;
+    }
+
+    // Enables the backlog. Entries are replayed to `topic` as events of type "snapshot".
+    void setReplayTopic(std::string_view topic) {
+        std::lock_guard<std::recursive_mutex> lock(manager_mutex_);
+        replay_topic_ = std::string{topic};
+    }
+
+    // Backlog entries sent per second once the broker is back.
+    void setReplayRate(uint32_t messages_per_second) {
+        std::lock_guard<std::recursive_mutex> lock(manager_mutex_);
+        replay_interval_ms_ = 1000 / std::max<uint32_t>(messages_per_second, 1);
+    }
+
+    // How long the last complete discovery took, from the first config until the client flushed the last.
+    uint32_t getLastDiscoveryMillis() const {
+        std::lock_guard<std::recursive_mutex> lock(manager_mutex_);
+        return last_discovery_millis_;
+    }
+
+    BacklogStats getBacklogStats() const {
+        return backlog_.getStats();
     }
 
     void reportState(bool force = false) {
         std::lock_guard<std::recursive_mutex> lock(manager_mutex_);
         if (!mqtt_client_->isConnected()) {
-            discovery_published_ = false; // Reset discovery on disconnect
+            // The broker keeps retained configs across our reconnects, so only an
+            // unfinished round starts over: its last configs may have been dropped
+            // from the client's outbox with the connection.
+            if (discovery_running_) restartDiscovery();
+            was_connected_ = false;
+            queueState();
             return;
         }
 
-        bool was_published = discovery_published_;
-        if (!discovery_published_) publishDiscovery();
-        if (!discovery_published_) return;
-
-        if (!was_published) force = true;
+        // Right after (re)connecting everything goes out, changed or not. The connection
+        // count catches a reconnect that happened between two calls.
+        const uint32_t connection_count = mqtt_client_->getConnectionCount();
+        bool resend = !was_connected_ || connection_count != connection_count_;
+        if (was_connected_ && connection_count != connection_count_ && discovery_running_) restartDiscovery();
+        was_connected_ = true;
+        connection_count_ = connection_count;
+        if (resend) force = true;
+        if (!discovery_published_) {
+            if (!publishDiscoveryStep()) return;
+            discovery_published_ = true;
+            resend = true;
+            force = true;
+        }
 
         uint32_t now = millis();
         if (!force && (now - last_report_time_ < report_interval_)) return;
         last_report_time_ = now;
 
-        StaticJsonDocument<1024> state_json; // Slightly larger for safety
-        JsonObject root = state_json.to<JsonObject>();
+        JsonObject root = populateState();
+        if (state_json_.size() == 0 || components_.empty()) return;
+        if (entity_state_base_.empty()) {
+            publishSharedState(state_json_, resend);
+        } else {
+            publishEntityStates(root, resend);
+        }
+    }
+
+    // Publishes each state field to its own short topic. Must be called before any component is added.
+    void setPerEntityStateTopics(bool enabled) {
+        std::lock_guard<std::recursive_mutex> lock(manager_mutex_);
+        entity_state_base_ = enabled ? std::string{device_->getDeviceId()} : std::string{};
+    }
+
+    // Payload bytes of state reports handed to the client since boot.
+    uint32_t getStateBytesSent() const {
+        std::lock_guard<std::recursive_mutex> lock(manager_mutex_);
+        return state_bytes_sent_;
+    }
+
+    // State messages handed to the client since boot.
+    uint32_t getStatePublishCount() const {
+        std::lock_guard<std::recursive_mutex> lock(manager_mutex_);
+        return state_publishes_;
+    }
+
+    // Sends the oldest backlog entry, at most one per replay interval. Live
+    // reports go first: reportState() forces one right after a reconnect.
+    void replayBacklog() {
+        std::lock_guard<std::recursive_mutex> lock(manager_mutex_);
+        if (!discovery_published_ || replay_topic_.empty() || backlog_.empty()) return;
+
+        const uint32_t now = millis();
+        if (now - last_replay_time_ < replay_interval_ms_) return;
+        last_replay_time_ = now;
+
+        backlog_.sendFront([this](uint32_t, std::string_view payload) {
+            return mqtt_client_->publish(replay_topic_, payload, false);
+        });
+    }
+
+private:
+    // Sends the next discovery config if the byte budget allows. Returns true once all
+    // have been sent and the client has written them to the broker.
+    bool publishDiscoveryStep() {
+        const uint32_t now = millis();
+        if (discovery_cache_.empty()) buildDiscoveryCache();
+        if (!discovery_running_) {
+            discovery_running_ = true;
+            discovery_started_ = now;
+            discovery_budget_time_ = now;
+            discovery_budget_ = discovery_bytes_per_second;
+        }
+
+        const uint32_t elapsed = std::min<uint32_t>(now - discovery_budget_time_, 1000);
+        const uint32_t refill = elapsed * discovery_bytes_per_second / 1000;
+        if (refill > 0) {
+            discovery_budget_ = std::min(discovery_budget_ + refill, discovery_bytes_per_second);
+            discovery_budget_time_ = now;
+        }
+
+        while (discovery_next_ < discovery_cache_.size() && discovery_cache_[discovery_next_].sent) {
+            discovery_next_++;
+        }
+        if (discovery_next_ < discovery_cache_.size()) {
+            DiscoveryMessage& message = discovery_cache_[discovery_next_];
+            // A config larger than the whole budget goes out once the budget is full.
+            const uint32_t cost = std::min<uint32_t>(message.payload.size(), discovery_bytes_per_second);
+            if (discovery_budget_ < cost) return false;
+            if (!mqtt_client_->publishPersistent(message.topic, message.payload, true)) return false;
+
+            message.sent = true;
+            discovery_budget_ -= cost;
+            discovery_next_++;
+            if (discovery_next_ < discovery_cache_.size()) return false;
+        }
+
+        // Queued is not delivered. Checked before the connection: the client marks
+        // itself disconnected before it drops its outbox.
+        if (!mqtt_client_->isFlushed()) return false;
+        if (!mqtt_client_->isConnected() || mqtt_client_->getConnectionCount() != connection_count_) return false;
+
+        discovery_running_ = false;
+        last_discovery_millis_ = now - discovery_started_;
+        if (discovery_mode_switch_) {
+            discovery_mode_switch_ = false;
+            device_discovery_on_broker_ = device_discovery_;
+            if (discovery_mode_cb_) discovery_mode_cb_(device_discovery_);
+        }
+        return true;
+    }
+
+    // Switching modes follows Home Assistant's migration: a migrate message on the
+    // topics of the old mode, the configs of the new one, then the old topics cleared.
+    // The entities keep their unique ids, so their history and settings stay with them.
+    // Only done when the mode differs from what the broker was left with.
+    void buildDiscoveryCache() {
+        const std::string device_topic = discovery_prefix_ + "/device/" + std::string{device_->getDeviceId()} + "/config";
+        discovery_mode_switch_ = device_discovery_ != device_discovery_on_broker_;
+
+        if (discovery_mode_switch_) {
+            if (device_discovery_) {
+                for (const auto& component : components_) addOnceMessage(component->getDiscoveryTopic(), migrate_payload);
+            } else {
+                addOnceMessage(device_topic, migrate_payload);
+            }
+        }
+
+        if (device_discovery_) {
+            DynamicJsonDocument doc(device_discovery_capacity);
+            JsonObject root = doc.to<JsonObject>();
+            Component::populateDeviceDiscovery(root, *device_);
+            JsonObject origin = root.createNestedObject("o");
+            origin["name"] = std::string{device_->getDeviceName()};
+            origin["sw"] = std::string{device_->getSoftwareVersion()};
+            JsonObject cmps = root.createNestedObject("cmps");
+            for (const auto& component : components_) {
+                JsonObject entry = cmps.createNestedObject(std::string{component->getObjectId()});
+                entry["p"] = std::string{component->getComponentType()};
+                component->populateDiscovery(entry);
+            }
+            if (doc.overflowed()) {
+                Logger::getInstance().log(Logger::Level::Error, "HA: Device discovery config truncated");
+            }
+            addDiscoveryMessage(device_topic, doc);
+        } else {
+            for (const auto& component : components_) {
+                StaticJsonDocument<1024> doc;
+                JsonObject root = doc.to<JsonObject>();
+                Component::populateDeviceDiscovery(root, *device_);
+                component->populateDiscovery(root);
+                addDiscoveryMessage(component->getDiscoveryTopic(), doc);
+            }
+        }
+
+        if (discovery_mode_switch_) {
+            if (device_discovery_) {
+                for (const auto& component : components_) addOnceMessage(component->getDiscoveryTopic(), "");
+            } else {
+                addOnceMessage(device_topic, "");
+            }
+        }
+    }
+
+    // An empty payload clears the retained config.
+    void addOnceMessage(std::string topic, std::string_view payload) {
+        DiscoveryMessage& message = discovery_cache_.emplace_back();
+        message.topic = std::move(topic);
+        message.payload = std::string{payload};
+        message.once = true;
+    }
+
+    void addDiscoveryMessage(std::string topic, const JsonDocument& doc) {
+        DiscoveryMessage& message = discovery_cache_.emplace_back();
+        message.topic = std::move(topic);
+        message.payload.reserve(measureJson(doc));
+        serializeJson(doc, message.payload);
+    }
+
+    static uint32_t fnv1a(std::string_view text) {
+        uint32_t hash = 2166136261u;
+        for (char c : text) {
+            hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+        }
+        return hash;
+    }
+
+    void addCommandRoute(const std::string& topic, Component* component) {
+        if (command_route_count_ >= command_table_size / 2) {
+            Logger::getInstance().log(Logger::Level::Error, "HA: command table full, ignoring %s", topic.c_str());
+            return;
+        }
+
+        const uint32_t hash = fnv1a(topic);
+        size_t slot = hash & (command_table_size - 1);
+        while (command_routes_[slot].component && command_routes_[slot].topic != topic) {
+            slot = (slot + 1) & (command_table_size - 1);
+        }
+        if (!command_routes_[slot].component) command_route_count_++;
+        command_routes_[slot] = CommandRoute{ hash, topic, component };
+    }
+
+    Component* findCommandHandler(std::string_view topic) const {
+        const uint32_t hash = fnv1a(topic);
+        for (size_t slot = hash & (command_table_size - 1); command_routes_[slot].component;
+             slot = (slot + 1) & (command_table_size - 1)) {
+            const CommandRoute& route = command_routes_[slot];
+            if (route.hash == hash && route.topic == topic) return route.component;
+        }
+        return nullptr;
+    }
+
+    // Fills state_json_ from every component.
+    JsonObject populateState() {
+        JsonObject root = state_json_.to<JsonObject>();
         for (const auto& comp : components_) {
             comp->populateState(root);
         }
-        
-        if (state_json.size() > 0 && !components_.empty()) {
-            std::string payload;
-            serializeJson(state_json, payload);
-            mqtt_client_->publish(components_.front()->getStateTopic().c_str(), payload.c_str(), true);
+        if (state_json_.overflowed()) {
+            Logger::getInstance().log(Logger::Level::Error, "HA: State document truncated");
+        }
+        return root;
+    }
+
+    void publishSharedState(const JsonDocument& state_json, bool resend) {
+        std::string payload;
+        serializeJson(state_json, payload);
+        const uint32_t hash = fnv1a(payload);
+        if (!resend && hash == published_state_hash_) return;
+
+        if (mqtt_client_->publish(components_.front()->getStateTopic(), payload, true)) {
+            published_state_hash_ = hash;
+            state_bytes_sent_ += payload.size();
+            state_publishes_++;
+        }
+    }
+
+    void publishEntityStates(const JsonObject& root, bool resend) {
+        std::string payload;
+        std::string topic;
+        for (JsonPair field : root) {
+            payload.clear();
+            if (field.value().is<const char*>()) {
+                payload = field.value().as<const char*>(); // bare value, no quotes
+            } else {
+                serializeJson(field.value(), payload);
+            }
+
+            const std::string_view key = field.key().c_str();
+            const uint32_t key_hash = fnv1a(key);
+            const uint32_t value_hash = fnv1a(payload);
+            auto published = std::find_if(published_fields_.begin(), published_fields_.end(),
+                [key_hash](const PublishedField& f) { return f.key_hash == key_hash; });
+            if (!resend && published != published_fields_.end() && published->value_hash == value_hash) continue;
+
+            topic.assign(entity_state_base_).append("/").append(key);
+            if (!mqtt_client_->publish(topic, payload, true)) continue;
+            state_bytes_sent_ += payload.size();
+            state_publishes_++;
+
+            if (published != published_fields_.end()) {
+                published->value_hash = value_hash;
+            } else {
+                published_fields_.push_back(PublishedField{ key_hash, value_hash });
+            }
+        }
+    }
+
+    // Snapshots the scalar states, stamped with the wall clock, into the backlog.
+    // Attributes are left out; they are derived values and would eat the space.
+    void queueState() {
+        if (components_.empty() || replay_topic_.empty()) return;
+
+        const uint32_t now = millis();
+        if (last_backlog_time_ != 0 && now - last_backlog_time_ < backlog_interval_ms) return;
+
+        const time_t wall_time = time(nullptr);
+        if (wall_time < min_valid_time) return;
+
+        JsonObject root = populateState();
+        snapshot_json_.clear();
+        snapshot_json_["event_type"] = "snapshot";
+        snapshot_json_["ts"] = static_cast<uint32_t>(wall_time);
+        for (JsonPair pair : root) {
+            if (!pair.value().is<JsonObject>()) snapshot_json_[pair.key()] = pair.value();
+        }
+
+        std::string payload;
+        serializeJson(snapshot_json_, payload);
+        if (backlog_.push(static_cast<uint32_t>(wall_time), payload)) {
+            last_backlog_time_ = now;
         }
     }
 };
@@ -16,9 +16,18 @@ public:
     virtual ~MqttClient() = default;
 
     virtual bool publish(std::string_view topic, std::string_view payload, bool retain = false) = 0;
+    // Like publish(), for payloads that stay valid and unchanged for the client's lifetime.
+    // Clients may send them from the caller's buffer instead of copying.
+    virtual bool publishPersistent(std::string_view topic, std::string_view payload, bool retain = false) {
+        return publish(topic, payload, retain);
+    }
     virtual void subscribe(const std::string& topic) = 0;
     virtual void setCallback(MessageCallback callback) = 0;
     virtual bool isConnected() const = 0;
+    // Counts the connections made so far. Messages queued before it changed may have been lost.
+    virtual uint32_t getConnectionCount() const { return 0; }
+    // True once every message queued so far has been written to the broker.
+    virtual bool isFlushed() const { return true; }
 };
 
 } // namespace ha
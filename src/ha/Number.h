@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Component.h"
+#include <cstring>
 #include <functional>
 
 namespace ha {
@@ -29,14 +30,13 @@ public:
     {
     }
 
-    StaticJsonDocument<1024> getDiscoveryPayload(const Device& device) const override {
-        StaticJsonDocument<1024> doc = Component::getDiscoveryPayload(device);
+    void populateDiscovery(JsonObject& doc) const override {
+        Component::populateDiscovery(doc);
         doc["cmd_t"] = command_topic_;
         doc["min"] = min_val_;
         doc["max"] = max_val_;
         doc["step"] = step_val_;
-        doc["val_tpl"] = std::string("{{ value_json.").append(object_id_).append(" }}");
-        return doc;
+        addStateField(doc, "stat_t", "val_tpl", object_id_);
     }
 
     std::string getCommandTopic() const override {
@@ -55,11 +55,16 @@ public:
         current_value_ = value;
     }
 
-    void handleCommand(const std::string& topic, const std::string& payload) override {
-        if (payload.empty()) return;
+    void handleCommand(std::string_view /*topic*/, std::string_view payload) override {
+        // strtof needs a terminated string; anything longer than this isn't a number anyway.
+        char text[24];
+        if (payload.empty() || payload.size() >= sizeof(text)) return;
+        memcpy(text, payload.data(), payload.size());
+        text[payload.size()] = '\0';
+
         char* end = nullptr;
-        float new_val = std::strtof(payload.c_str(), &end);
-        if (end == payload.c_str()) return; // Parse failed
+        float new_val = std::strtof(text, &end);
+        if (end == text) return; // Parse failed
         current_value_ = new_val;
         if (callback_) {
             callback_(new_val);
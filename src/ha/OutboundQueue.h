@@ -0,0 +1,129 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+
+namespace ha {
+
+// Bounded FIFO of state payloads held back while the broker is unreachable.
+// Entries are packed back to back in a fixed byte ring, so the capacity is
+// spent on payload bytes rather than on a fixed number of slots. When an
+// entry doesn't fit, the oldest ones are dropped to make room.
+template <size_t Capacity>
+class OutboundQueue {
+public:
+    static constexpr size_t max_payload_size = 512;
+
+    struct Stats {
+        size_t depth;          // entries waiting
+        size_t bytes;          // ring bytes in use
+        uint32_t queued;
+        uint32_t replayed;
+        uint32_t dropped;
+        uint32_t last_drain_latency_ms; // time the last replayed entry spent queued
+        uint32_t max_drain_latency_ms;
+    };
+
+private:
+    struct EntryHeader {
+        uint32_t time;          // wall clock of the snapshot, seconds
+        uint32_t queued_millis;
+        uint16_t length;
+    };
+
+    std::array<uint8_t, Capacity> buffer_{};
+    // Entries may wrap around the end of the ring; sendFront() hands the sender a contiguous
+    // copy from here rather than from the caller's stack. Guarded by mutex_.
+    std::array<char, max_payload_size> send_buffer_{};
+    size_t head_ = 0; // offset of the oldest entry
+    size_t used_ = 0;
+    size_t depth_ = 0;
+
+    uint32_t queued_ = 0;
+    uint32_t replayed_ = 0;
+    uint32_t dropped_ = 0;
+    uint32_t last_drain_latency_ms_ = 0;
+    uint32_t max_drain_latency_ms_ = 0;
+
+    mutable std::mutex mutex_;
+
+    void copyOut(size_t offset, void* dest, size_t length) const {
+        uint8_t* out = static_cast<uint8_t*>(dest);
+        for (size_t i = 0; i < length; i++) out[i] = buffer_[(offset + i) % Capacity];
+    }
+
+    void copyIn(size_t offset, const void* src, size_t length) {
+        const uint8_t* in = static_cast<const uint8_t*>(src);
+        for (size_t i = 0; i < length; i++) buffer_[(offset + i) % Capacity] = in[i];
+    }
+
+    // Expects mutex_ to be held.
+    void popFront() {
+        EntryHeader header;
+        copyOut(head_, &header, sizeof(header));
+        const size_t size = sizeof(header) + header.length;
+        head_ = (head_ + size) % Capacity;
+        used_ -= size;
+        depth_--;
+    }
+
+public:
+    // Returns false if the payload is larger than max_payload_size.
+    bool push(uint32_t time, std::string_view payload) {
+        const size_t size = sizeof(EntryHeader) + payload.size();
+        if (payload.size() > max_payload_size || size > Capacity) return false;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (used_ + size > Capacity) {
+            popFront();
+            dropped_++;
+        }
+
+        const EntryHeader header{ time, static_cast<uint32_t>(millis()), static_cast<uint16_t>(payload.size()) };
+        const size_t tail = (head_ + used_) % Capacity;
+        copyIn(tail, &header, sizeof(header));
+        copyIn(tail + sizeof(header), payload.data(), payload.size());
+        used_ += size;
+        depth_++;
+        queued_++;
+        return true;
+    }
+
+    // Hands the oldest entry to `send(uint32_t time, std::string_view payload) -> bool`
+    // and removes it if that returned true. Returns false if the queue was empty or
+    // sending failed.
+    template <typename Send>
+    bool sendFront(Send&& send) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (depth_ == 0) return false;
+
+        EntryHeader header;
+        copyOut(head_, &header, sizeof(header));
+
+        copyOut(head_ + sizeof(header), send_buffer_.data(), header.length);
+        if (!send(header.time, std::string_view(send_buffer_.data(), header.length))) return false;
+
+        last_drain_latency_ms_ = millis() - header.queued_millis;
+        if (last_drain_latency_ms_ > max_drain_latency_ms_) max_drain_latency_ms_ = last_drain_latency_ms_;
+        replayed_++;
+        popFront();
+        return true;
+    }
+
+    bool empty() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return depth_ == 0;
+    }
+
+    Stats getStats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return Stats{ depth_, used_, queued_, replayed_, dropped_, last_drain_latency_ms_, max_drain_latency_ms_ };
+    }
+};
+
+} // namespace ha
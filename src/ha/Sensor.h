@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include "Component.h"
 
 namespace ha {
@@ -8,10 +9,18 @@ class Sensor : public Component {
 private:
     const std::string device_class_;
     const std::string unit_of_measurement_;
-    const std::string value_template_;
     const std::string entity_category_;
     const std::string icon_;
     std::string manual_state_;
+
+    struct Attribute {
+        const char* key;
+        double value;
+    };
+    static constexpr size_t max_attributes = 8;
+    std::array<Attribute, max_attributes> attributes_{};
+    size_t attribute_count_ = 0;
+    bool attributes_enabled_ = false;
     
 public:
     Sensor(const Device& device,
@@ -25,28 +34,65 @@ public:
         : Component(device, "sensor", object_id, friendly_name, discovery_prefix)
         , device_class_{device_class_name}
         , unit_of_measurement_{unit}
-        , value_template_(std::string{"{{ value_json."} + std::string{object_id} + " }}")
         , entity_category_{category}
         , icon_{icon_name}
     {
     }
 
-    void updateState(std::string_view state) {
-        manual_state_ = std::string{state};
+    // Returns whether the state changed. Reuses the string's buffer, so an update
+    // only allocates when the text outgrows it.
+    bool updateState(std::string_view state) {
+        if (manual_state_ == state) return false;
+        manual_state_.assign(state.data(), state.size());
+        return true;
     }
 
     std::string getStatePayload() const override {
         return manual_state_;
     }
 
-    StaticJsonDocument<1024> getDiscoveryPayload(const Device& device) const override {
-        StaticJsonDocument<1024> doc = Component::getDiscoveryPayload(device);
+    // Announces JSON attributes in discovery. Must be called before the sensor is added to the manager.
+    void enableAttributes() {
+        attributes_enabled_ = true;
+    }
+
+    // Sets an attribute that is sent along with the state, as "<object_id>_attr": { key: value }.
+    // `key` must outlive the sensor. Returns whether the attribute changed.
+    bool updateAttribute(const char* key, double value) {
+        for (size_t i = 0; i < attribute_count_; i++) {
+            if (attributes_[i].key == key) {
+                if (attributes_[i].value == value) return false;
+                attributes_[i].value = value;
+                return true;
+            }
+        }
+        if (attribute_count_ < max_attributes) {
+            attributes_[attribute_count_++] = Attribute{ key, value };
+            return true;
+        }
+        return false;
+    }
+
+    void populateState(JsonObject& doc) const override {
+        Component::populateState(doc);
+        if (attribute_count_ == 0) return;
+
+        JsonObject attributes = doc.createNestedObject(object_id_ + "_attr");
+        for (size_t i = 0; i < attribute_count_; i++) {
+            attributes[attributes_[i].key] = attributes_[i].value;
+        }
+    }
+
+    void populateDiscovery(JsonObject& doc) const override {
+        Component::populateDiscovery(doc);
         if (!device_class_.empty()) doc["dev_cla"] = device_class_;
-        doc["val_tpl"] = value_template_;
+        addStateField(doc, "stat_t", "val_tpl", object_id_);
         if (!unit_of_measurement_.empty()) doc["unit_of_meas"] = unit_of_measurement_;
         if (!entity_category_.empty()) doc["ent_cat"] = entity_category_;
         if (!icon_.empty()) doc["icon"] = icon_;
-        return doc;
+        if (attributes_enabled_) {
+            addStateField(doc, "json_attr_t", "json_attr_tpl", object_id_ + "_attr", " | default({}) | tojson");
+        }
     }
 
     std::string getDeviceClass() const {
@@ -9,8 +9,24 @@
 
 namespace ha {
 
+// Lanes of the report scheduler. A control echo (switch, number, fan) must
+// reach HA quickly so the UI doesn't bounce back; telemetry can wait a bit
+// longer and be merged with whatever else changes meanwhile.
+enum class ReportPriority { Control, Telemetry };
+
 class StateReporter {
 public:
+    // Coalescing windows: a report goes out this long after the first request in a lane,
+    // no matter how many more arrive in between, so each window is also the latency bound.
+    static constexpr uint32_t control_window_ms = 20;
+    static constexpr uint32_t telemetry_window_ms = 250;
+
+    struct Stats {
+        uint32_t control_requests;
+        uint32_t telemetry_requests;
+        uint32_t reports; // reports the requests were coalesced into
+    };
+
     StateReporter(std::shared_ptr<ha::Device> device,
                   std::shared_ptr<ha::MqttClient> mqtt_client,
                   std::shared_ptr<ha::Manager> manager)
@@ -42,28 +58,40 @@ public:
                 if (device_) {
                     mqtt_client_->publish(device_->getAvailabilityTopic(), device_->getAvailabilityPayloadOnline(), true);
                 }
-                // Force immediate state report so HA gets current values
+                // Immediate state report so HA gets current values; it covers whatever the callback requested.
+                takeDueReport(true);
                 if (manager_) manager_->reportState(true);
             }
             
             if (manager_) manager_->reportState(); 
             
-            if (needs_report_) {
+            if (takeDueReport(false)) {
                 if (manager_) manager_->reportState(true);
-                needs_report_ = false;
             }
+
+            if (manager_) manager_->replayBacklog();
         } else {
             last_connected_state_ = false;
+            // Keeps snapshotting into the manager's backlog while offline.
+            if (manager_) manager_->reportState();
         }
     }
 
-    void requestReport() {
-        needs_report_ = true;
+    // Marks the state dirty. The report goes out once the lane's window has passed.
+    void requestReport(ReportPriority priority = ReportPriority::Telemetry) {
+        std::lock_guard<std::mutex> lock(schedule_mutex_);
+        const uint32_t window = priority == ReportPriority::Control ? control_window_ms : telemetry_window_ms;
+        const uint32_t due = millis() + window;
+        if (!report_pending_ || static_cast<int32_t>(due - report_due_millis_) < 0) {
+            report_due_millis_ = due;
+        }
+        report_pending_ = true;
+        (priority == ReportPriority::Control ? control_requests_ : telemetry_requests_)++;
     }
 
-    void forceReport() {
-        std::lock_guard<std::mutex> lock(mutex_);
-        if (manager_) manager_->reportState(true);
+    Stats getStats() const {
+        std::lock_guard<std::mutex> lock(schedule_mutex_);
+        return Stats{ control_requests_, telemetry_requests_, reports_ };
     }
 
 private:
@@ -71,11 +99,29 @@ private:
     std::shared_ptr<ha::MqttClient> mqtt_client_;
     std::shared_ptr<ha::Manager> manager_;
     
-    bool needs_report_ = false;
     bool last_connected_state_ = false;
     ReconnectedCallback reconnected_cb_;
     
     mutable std::mutex mutex_;
+
+    // Both lanes share one dirty flag: a report always carries the full state,
+    // so the earliest deadline wins and clears every pending request.
+    bool report_pending_ = false;
+    uint32_t report_due_millis_ = 0;
+    uint32_t control_requests_ = 0;
+    uint32_t telemetry_requests_ = 0;
+    uint32_t reports_ = 0;
+    mutable std::mutex schedule_mutex_;
+
+    // Clears the pending request if it is due, or unconditionally with `now`. Returns whether one was pending.
+    bool takeDueReport(bool now) {
+        std::lock_guard<std::mutex> lock(schedule_mutex_);
+        if (!report_pending_) return false;
+        if (!now && static_cast<int32_t>(millis() - report_due_millis_) < 0) return false;
+        report_pending_ = false;
+        reports_++;
+        return true;
+    }
 };
 
 } // namespace ha
@@ -23,15 +23,14 @@ public:
     {
     }
 
-    StaticJsonDocument<1024> getDiscoveryPayload(const Device& device) const override {
-        StaticJsonDocument<1024> doc = Component::getDiscoveryPayload(device);
+    void populateDiscovery(JsonObject& doc) const override {
+        Component::populateDiscovery(doc);
         doc["cmd_t"] = command_topic_;
         doc["payload_on"] = "ON";
         doc["payload_off"] = "OFF";
         doc["state_on"] = "ON";
         doc["state_off"] = "OFF";
-        doc["val_tpl"] = std::string("{{ value_json.").append(object_id_).append(" }}");
-        return doc;
+        addStateField(doc, "stat_t", "val_tpl", object_id_);
     }
 
     std::string getCommandTopic() const override {
@@ -50,7 +49,7 @@ public:
         current_state_ = state;
     }
 
-    void handleCommand(const std::string& topic, const std::string& payload) override {
+    void handleCommand(std::string_view /*topic*/, std::string_view payload) override {
         bool new_state = (payload == "ON");
         updateState(new_state);
         if (callback_) {
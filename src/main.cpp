@@ -12,11 +12,11 @@
 #include <Arduino.h>
 #include "ArduinoJson.h"
 #include "PubSubClient.h"
-#include "SoftwareSerial.h"
 #include "WiFi.h"
 #include "driver/ledc.h"
 
 #include "AppState.h"
+#include "AqiEngine.h"
 #include "ConfigKeys.h"
 #include "ConfigManager.h"
 #include "WebConfig.h"
@@ -24,23 +24,38 @@
 #include "BootAnimation.h"
 #include "DHT20Wrapper.h"
 #include "Display.h"
+#include "HistoryLog.h"
+#include "HistoryStore.h"
 #include "ha/Integration.h"
 #include "Logger.h"
 #include "MHZ19Wrapper.h"
 #include "Measurement.h"
+#include "OnlineStats.h"
 #include "OtaManager.h"
+#include "PartitionFlashRegion.h"
 #include "PMWrapper.h"
 #include "PWMFan.h"
 #include "ReconnectingPubSubClient.h"
+#include "SensorScheduler.h"
 #include "Translator.h"
 #include "WifiManager.h"
 #include <Update.h>
 
 // ── Constants ──────────────────────────────────────────────────
 static constexpr uint32_t mhz19_baud_rate = 9600;
+static constexpr uint32_t dht20_sample_period_millis = 5000;
+static constexpr uint8_t dht20_oversampling = 12;
+static constexpr uint32_t mhz19_sample_period_millis = 15000;
+static constexpr uint8_t mhz19_oversampling = 4;
 static constexpr uint32_t fan_frequency_hz = 25000;
 static constexpr std::string_view app_version = "1.1.0";
 static constexpr std::string_view device_prefix = "smaq_";
+static constexpr const char* ntp_server = "pool.ntp.org";
+static constexpr size_t aqi_display_page = measurement_type_count;
+// The backlog fills while the sensors may be stalled, so its status has its own cadence.
+static constexpr uint32_t backlog_report_interval_millis = 10000;
+static constexpr const char* history_partition_label = "spiffs";
+static constexpr uint32_t history_flush_interval_millis = 10000;
 
 // ── Application State ──────────────────────────────────────────
 AppState app;
@@ -58,7 +73,17 @@ std::shared_ptr<ReconnectingPubSubClient> reconnecting_mqtt_client;
 std::unique_ptr<ha::Integration> ha_integration;
 
 // ── Sensors ────────────────────────────────────────────────────
-std::vector<std::unique_ptr<SensorDriver>> sensors;
+DHT20Wrapper dht20(app.i2c_mutex);
+MHZ19Wrapper mhz19(Serial1, MHZ19_TX, MHZ19_RX, mhz19_baud_rate);
+PMWrapper pms(Serial2, PMS_TX, PMS_RX);
+SensorSet<DHT20Wrapper, MHZ19Wrapper, PMWrapper> sensors(dht20, mhz19, pms);
+
+// ── History ────────────────────────────────────────────────────
+HistoryStore history;
+PartitionFlashRegion history_partition;
+HistoryLog history_log(history_partition);
+MeasurementStatistics statistics;
+AqiEngine aqi;
 
 // ── Managers ───────────────────────────────────────────────────
 std::unique_ptr<OtaManager> ota_manager;
@@ -121,21 +146,22 @@ void setupHa() {
         });
 
         ha_integration->setConfigSaveCallback([](const std::string& key, int value) {
-            if (key == cfg::keys::enable_display) ConfigManager::getInstance().putBool(key.c_str(), (bool)value);
+            if (key == cfg::keys::enable_display || key == cfg::keys::ha_device_discovery_active) ConfigManager::getInstance().putBool(key.c_str(), (bool)value);
             else ConfigManager::getInstance().putInt(key.c_str(), value);
             
             if (key == cfg::keys::display_interval) app.display_each_measurement_for_in_millis.store(value * 1000);
             if (key == cfg::keys::report_interval) app.report_interval_in_seconds.store(value * 60);
         });
 
+        ha_integration->setPerEntityStateTopics(ConfigManager::getInstance().getBool(cfg::keys::ha_per_entity_topics, cfg::defaults::ha_per_entity_topics));
+        ha_integration->setDeviceDiscovery(ConfigManager::getInstance().getBool(cfg::keys::ha_device_discovery, cfg::defaults::ha_device_discovery),
+                                           ConfigManager::getInstance().getBool(cfg::keys::ha_device_discovery_active, cfg::defaults::ha_device_discovery_active));
         ha_integration->begin();
+        ha_integration->setReplayRate(ConfigManager::getInstance().getInt(cfg::keys::mqtt_replay_rate, cfg::defaults::mqtt_replay_rate));
 
-        ha_integration->addSensor(MeasurementType::Temperature, "temp", "Temperature", "temperature", "°C");
-        ha_integration->addSensor(MeasurementType::Humidity, "hum", "Humidity", "humidity", "%");
-        ha_integration->addSensor(MeasurementType::CO2, "co2", "CO2", "carbon_dioxide", "ppm");
-        ha_integration->addSensor(MeasurementType::PM1, "pm1", "PM1", "pm1", "µg/m³");
-        ha_integration->addSensor(MeasurementType::PM25, "pm25", "PM2.5", "pm25", "µg/m³");
-        ha_integration->addSensor(MeasurementType::PM10, "pm10", "PM10", "pm10", "µg/m³");
+        sensors.forEachEntity([](const SensorEntity& entity) {
+            ha_integration->addSensor(entity.type, entity.object_id, entity.name, entity.device_class, entity.unit);
+        });
 
         ha_integration->setReconnectedCallback([]() {
             logger.log(Logger::Level::Info, "MQTT connection established, syncing HA state");
@@ -172,49 +198,42 @@ void setupMqtt(std::string_view mqtt_device_id, std::string_view lwt_topic, std:
     reconnecting_mqtt_client = std::make_shared<ReconnectingPubSubClient>(
         broker.c_str(), port, user.c_str(), password.c_str(), mqtt_device_id,
         lwt_topic, lwt_payload, true, 0);
+    reconnecting_mqtt_client->begin();
 }
 
 // ═══════════════════════════════════════════════════════════════
 //  Sensors
 // ═══════════════════════════════════════════════════════════════
 
-// ── Sensor Names (for health reporting) ────────────────────────
-static const char* sensor_names[] = { "DHT20", "MHZ19", "PMS5003" };
-std::vector<bool> sensor_health;
-
 void initializeSensors() {
-    sensors.push_back(std::make_unique<DHT20Wrapper>(app.i2c_mutex));
-    sensors.push_back(std::make_unique<MHZ19Wrapper>(MHZ19_RX, MHZ19_TX, mhz19_baud_rate));
-    sensors.push_back(std::make_unique<PMWrapper>(PMS5003, PMS_TX, PMS_RX));
-
-    sensor_health.resize(sensors.size(), false);
-
-    for (size_t i = 0; i < sensors.size(); i++) {
-        if (!sensors[i]->begin()) {
-            logger.log(Logger::Level::Error, "Failed to initialize sensor: %s", sensor_names[i]);
-            display.show("Sensor Error!");
-            delay(2000);
-        } else {
-            sensor_health[i] = true;
-        }
-    }
+    sensors.configure<DHT20Wrapper>({ dht20_sample_period_millis, dht20_oversampling, FilterMode::TrimmedMean });
+    sensors.configure<MHZ19Wrapper>({ mhz19_sample_period_millis, mhz19_oversampling, FilterMode::Median });
+    sensors.configure<PMWrapper>({ app.report_interval_in_seconds.load() * 1000 });
+
+    sensors.begin([](const char* name) {
+        logger.log(Logger::Level::Error, "Failed to initialize sensor: %s", name);
+        display.show("Sensor Error!");
+        delay(2000);
+    });
 }
 
 void updateSensorHealthStatus() {
     if (!ha_integration) return;
-    std::string health;
-    for (size_t i = 0; i < sensors.size() && i < 3; i++) {
-        if (i > 0) health += ", ";
-        health += sensor_names[i];
-        health += ": ";
-        health += sensor_health[i] ? "OK" : "Error";
-    }
-    ha_integration->updateSensorHealth(health);
+    char health[96];
+    const size_t length = sensors.formatHealth(health, sizeof(health));
+    ha_integration->updateSensorHealth(std::string_view(health, length));
 }
 
-void sensorTask(void* parameter) {
-    uint32_t last_sensor_read_millis = 0;
+// Copies app.measurements into `frame` unless `frame` already holds the current generation.
+// Returns whether it copied.
+bool refreshMeasurements(SampleFrame& frame) {
+    if (app.measurements_generation.load() == frame.generation) return false;
+    std::lock_guard<std::mutex> lock(app.measurements_mutex);
+    frame = app.measurements;
+    return true;
+}
 
+void sensorTask(void* parameter) {
     for (;;) {
         esp_task_wdt_reset();
 
@@ -223,32 +242,51 @@ void sensorTask(void* parameter) {
             continue;
         }
 
+        uint32_t wait_millis = 100;
+
         if (app.is_setup) {
-            uint32_t now = millis();
-            uint32_t interval = app.report_interval_in_seconds.load() * 1000;
-
-            if (now - last_sensor_read_millis >= interval || last_sensor_read_millis == 0) {
-                std::vector<std::unique_ptr<Measurement>> new_measurements;
-                for (size_t i = 0; i < sensors.size(); i++) {
-                    bool ok = sensors[i]->provideMeasurements(new_measurements);
-                    sensor_health[i] = ok;
+            sensors.setPeriod<PMWrapper>(app.report_interval_in_seconds.load() * 1000);
+
+            wait_millis = sensors.tick(millis(), [](const SensorReading& reading) {
+                const SampleFrame& published = reading.published;
+                statistics.add(reading.sample);
+
+                for (size_t i = 0; i < reading.anomaly_count; i++) {
+                    const AnomalyReport& anomaly = reading.anomalies[i];
+                    logger.log(Logger::Level::Warning, "%s spike: %.2f (median %.2f, z=%.1f)%s",
+                               FriendlyNameTypeTranslator().translate(anomaly.type).data(),
+                               anomaly.value, anomaly.median, anomaly.score, anomaly.rejected ? ", rejected" : "");
+                    if (ha_integration) ha_integration->reportAnomaly(anomaly);
                 }
 
-                {
-                    std::lock_guard<std::mutex> lock(app.measurements_mutex);
-                    app.measurements.clear();
-                    for (auto& m : new_measurements) {
-                        app.measurements.push_back(std::move(m));
+                if (!published.empty()) {
+                    {
+                        std::lock_guard<std::mutex> lock(app.measurements_mutex);
+                        app.measurements.merge(published);
+                        app.measurements_generation.store(app.measurements.generation);
                     }
-                    app.current_display_index = 0;
+                    const uint32_t now = time(nullptr);
+                    history.add(published, now);
+                    history_log.append(published, now);
+                    aqi.add(published, now);
                 }
 
-                updateSensorHealthStatus();
-                last_sensor_read_millis = now;
-            }
+                if (reading.health_changed || !published.empty()) {
+                    updateSensorHealthStatus();
+                }
+            });
         }
 
-        vTaskDelay(pdMS_TO_TICKS(100));
+        vTaskDelay(pdMS_TO_TICKS(std::clamp<uint32_t>(wait_millis, 10, 100)));
+    }
+}
+
+// Writes completed history pages; flash I/O never happens on the sensor task.
+void historyLogTask(void* parameter) {
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(history_flush_interval_millis));
+        if (app.ota_in_progress.load()) continue;
+        history_log.flush();
     }
 }
 
@@ -290,8 +328,69 @@ void setup() {
         display.show("Update Done!");
     });
 
+    web_config.setOnStatus([](JsonObject& status) {
+        status["loop_stack_free"] = app.loop_stack_free.load();
+
+        JsonObject dht20_status = status.createNestedObject("dht20");
+        dht20_status["last_lock_hold_us"] = dht20.getLastLockHoldMicros();
+        dht20_status["max_lock_hold_us"] = dht20.getMaxLockHoldMicros();
+
+        const MHZ19Wrapper::Stats stats = mhz19.getStats();
+        JsonObject mhz19_status = status.createNestedObject("mhz19");
+        mhz19_status["requests"] = stats.requests;
+        mhz19_status["timeouts"] = stats.timeouts;
+        mhz19_status["checksum_errors"] = stats.checksum_errors;
+        mhz19_status["last_latency_us"] = stats.last_latency_micros;
+        mhz19_status["max_latency_us"] = stats.max_latency_micros;
+
+        const HistoryLog::Stats log_stats = history_log.getStats();
+        JsonObject log_status = status.createNestedObject("history_log");
+        log_status["pages_written"] = log_stats.pages_written;
+        log_status["write_errors"] = log_stats.write_errors;
+        log_status["dropped_pages"] = log_stats.dropped_pages;
+        log_status["head_page"] = log_stats.head_page;
+        log_status["page_count"] = log_stats.page_count;
+
+        if (reconnecting_mqtt_client) {
+            const ReconnectingPubSubClient::Stats mqtt_stats = reconnecting_mqtt_client->getStats();
+            JsonObject mqtt_status = status.createNestedObject("mqtt");
+            mqtt_status["connected"] = reconnecting_mqtt_client->isConnected();
+            mqtt_status["connect_attempts"] = mqtt_stats.connect_attempts;
+            mqtt_status["dropped_publishes"] = mqtt_stats.dropped_publishes;
+            mqtt_status["dropped_messages"] = mqtt_stats.dropped_messages;
+            mqtt_status["outbox_bytes"] = mqtt_stats.outbox_bytes;
+            if (ha_integration) {
+                mqtt_status["discovery_ms"] = ha_integration->getLastDiscoveryMillis();
+                mqtt_status["state_bytes"] = ha_integration->getStateBytesSent();
+                mqtt_status["state_publishes"] = ha_integration->getStatePublishCount();
+
+                const ha::StateReporter::Stats report_stats = ha_integration->getReportStats();
+                mqtt_status["control_requests"] = report_stats.control_requests;
+                mqtt_status["telemetry_requests"] = report_stats.telemetry_requests;
+                mqtt_status["reports"] = report_stats.reports;
+            }
+        }
+
+        if (ha_integration && reconnecting_mqtt_client) {
+            const ha::Manager::BacklogStats backlog = ha_integration->getBacklogStats();
+            JsonObject backlog_status = status.createNestedObject("mqtt_backlog");
+            backlog_status["depth"] = backlog.depth;
+            backlog_status["bytes"] = backlog.bytes;
+            backlog_status["queued"] = backlog.queued;
+            backlog_status["replayed"] = backlog.replayed;
+            backlog_status["dropped"] = backlog.dropped;
+            backlog_status["drain_latency_ms"] = backlog.last_drain_latency_ms;
+            backlog_status["max_drain_latency_ms"] = backlog.max_drain_latency_ms;
+        }
+    });
+
+    web_config.setHistory(history);
+    web_config.setHistoryLog(history_log);
+    web_config.setStatistics(statistics);
+
     web_config.begin([]() {
         logger.log(Logger::Level::Info, "Config changed, rebooting...");
+        history_log.sync();
         delay(500);
         ESP.restart();
     });
@@ -311,6 +410,7 @@ void setup() {
 
     app.ip_address = wifi_manager.localIP();
     app.mac_id = cm.getMacId();
+    configTime(0, 0, ntp_server);
     display.setIpAddress(app.ip_address.toString().c_str());
 
     ota_manager->setup();
@@ -336,6 +436,10 @@ void setup() {
     
     setupHa();
 
+    if (!history_partition.begin(history_partition_label) || !history_log.begin()) {
+        logger.log(Logger::Level::Error, "History log disabled: partition '%s' not found", history_partition_label);
+    }
+
     boot_animation.setMessage("Sensors...");
     initializeSensors();
 
@@ -352,6 +456,7 @@ void setup() {
     esp_task_wdt_add(NULL);
 
     xTaskCreatePinnedToCore(sensorTask, "SensorTask", 16384, NULL, 1, &app.sensor_task_handle, 0);
+    xTaskCreatePinnedToCore(historyLogTask, "HistoryLog", 4096, NULL, tskIDLE_PRIORITY, nullptr, 1);
 
     logger.log(Logger::Level::Info, "Setup complete. IP: %s", app.ip_address.toString().c_str());
 }
@@ -360,6 +465,13 @@ void loop() {
     static uint32_t last_stack_check = 0;
     if (millis() - last_stack_check > 1000) {
         last_stack_check = millis();
+        // The high-water mark is in bytes on the ESP32; the loop task has 8 KiB.
+        const uint32_t stack_free = uxTaskGetStackHighWaterMark(nullptr);
+        const uint32_t previous = app.loop_stack_free.load();
+        if (stack_free < 1024 && (previous == 0 || stack_free < previous)) {
+            logger.log(Logger::Level::Warning, "Loop task stack low: %u bytes never used", stack_free);
+        }
+        app.loop_stack_free.store(stack_free);
     }
 
     esp_task_wdt_reset();
@@ -374,11 +486,14 @@ void loop() {
     uint32_t now = millis();
 
     if (reconnecting_mqtt_client) {
-         reconnecting_mqtt_client->loop();
+        // Only hands over received messages; the network I/O runs on its own task.
+        reconnecting_mqtt_client->loop();
     }
-    if (ha_integration && reconnecting_mqtt_client && reconnecting_mqtt_client->isConnected()) {
+    if (ha_integration && reconnecting_mqtt_client) {
+        // Also runs while disconnected, so states keep going into the backlog.
         ha_integration->loop();
-
+    }
+    if (ha_integration && reconnecting_mqtt_client && reconnecting_mqtt_client->isConnected()) {
         static IPAddress last_known_ip;
         if (last_known_ip != WiFi.localIP()) {
             last_known_ip = WiFi.localIP();
@@ -392,16 +507,42 @@ void loop() {
 
     web_config.loop();
 
+    // Each consumer keeps its own copy of the measurements and only refreshes it,
+    // under the mutex, when the generation moved on.
+    static SampleFrame ha_frame;
+    if (ha_integration && refreshMeasurements(ha_frame)) {
+        ha_integration->report(ha_frame);
+        ha_integration->reportStatistics(statistics);
+        ha_integration->reportAqi(aqi.summary(time(nullptr)));
+    }
+
+    static uint32_t last_backlog_report = 0;
+    if (ha_integration && now - last_backlog_report >= backlog_report_interval_millis) {
+        last_backlog_report = now;
+        ha_integration->reportBacklog();
+    }
+
     display.setConnectivity(WiFi.isConnected(), reconnecting_mqtt_client ? reconnecting_mqtt_client->isConnected() : false);
     uint32_t disp_interval = app.display_each_measurement_for_in_millis.load();
     if (now - app.last_display_update_millis >= disp_interval || app.last_display_update_millis == 0) {
-        std::lock_guard<std::mutex> lock(app.measurements_mutex);
-        if (!app.measurements.empty()) {
-            if (ha_integration) {
-                ha_integration->report(app.measurements);
+        static SampleFrame display_frame;
+        refreshMeasurements(display_frame);
+        if (!display_frame.empty()) {
+            // Every valid measurement in turn, then the AQI page once there is enough PM data.
+            size_t page = app.current_display_index;
+            while (page < measurement_type_count && !display_frame.has(static_cast<MeasurementType>(page))) page++;
+            if (page == aqi_display_page) {
+                const AqiSummary aqi_summary = aqi.summary(time(nullptr));
+                if (aqi_summary.valid) {
+                    display.showAqi(aqi_summary.aqi, aqi_summary.short_category);
+                } else {
+                    page = display_frame.nextValidIndex(0);
+                }
+            }
+            if (page < measurement_type_count) {
+                display.show(static_cast<MeasurementType>(page), display_frame);
             }
-            display.show(app.measurements[app.current_display_index]);
-            app.current_display_index = (app.current_display_index + 1) % app.measurements.size();
+            app.current_display_index = page < measurement_type_count ? page + 1 : 0;
             app.last_display_update_millis = now;
         }
     }
@@ -0,0 +1,27 @@
+#pragma once
+
+// Just enough of the Arduino core for the headers under test to build on the host.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+inline uint32_t micros() {
+    using namespace std::chrono;
+    return static_cast<uint32_t>(duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count());
+}
+
+// A test that drives time itself points this at its clock, and millis() reads it from then on.
+inline const uint32_t* host_millis_source = nullptr;
+
+inline uint32_t millis() {
+    return host_millis_source ? *host_millis_source : micros() / 1000;
+}
+
+struct HostSerial {
+    template <typename... Args>
+    void printf(const char* format, Args... args) { std::printf(format, args...); }
+    void println(const char* text) { std::puts(text); }
+};
+
+inline HostSerial Serial;
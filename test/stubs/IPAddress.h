@@ -0,0 +1,9 @@
+#pragma once
+
+#include <string>
+
+class IPAddress {
+public:
+    bool fromString(const char*) { return true; }
+    std::string toString() const { return "0.0.0.0"; }
+};
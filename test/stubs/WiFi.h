@@ -0,0 +1,9 @@
+#pragma once
+
+#include "Arduino.h"
+
+struct HostWiFi {
+    bool isConnected() const { return false; }
+};
+
+inline HostWiFi WiFi;
@@ -0,0 +1,131 @@
+#include <unity.h>
+
+#include <vector>
+
+#include "AnomalyDetector.h"
+
+// Traces recorded from a unit on the desk, one value per report interval.
+
+// MH-Z19 in a closed room, with one corrupt reply in the middle.
+static const std::vector<double> co2_spike_trace = {
+    612, 615, 611, 618, 620, 617, 622, 625, 621, 626, 629, 627, 633, 631, 636,
+    638, 5000, 641, 639, 644, 646, 643, 649, 651, 648, 653,
+};
+static constexpr size_t co2_spike_index = 16;
+
+// MH-Z19 when a second person walked into the room and closed the door.
+static const std::vector<double> co2_shift_trace = {
+    604, 607, 603, 609, 606, 611, 608, 605, 610, 607, 612, 609, 606, 611, 608,
+    1112, 1124, 1131, 1127, 1140, 1136, 1148, 1143, 1152, 1159, 1155, 1163, 1168, 1171, 1166,
+    1174, 1179, 1183, 1177, 1186,
+};
+static constexpr size_t co2_shift_index = 15;
+
+// PMS5003 PM2.5 while cooking: a short burst of smoke on top of a clean baseline.
+static const std::vector<double> pm25_trace = {
+    4, 5, 4, 3, 5, 6, 4, 5, 4, 5, 6, 5, 4, 5, 5,
+    87, 6, 5, 4, 5,
+};
+static constexpr size_t pm25_burst_index = 15;
+
+struct Judged {
+    bool kept;
+    bool reported;
+    bool rejected;
+};
+
+// Feeds `trace` as `type` and returns what happened to each sample.
+static std::vector<Judged> replay(AnomalyDetector& detector, MeasurementType type, const std::vector<double>& trace) {
+    std::vector<Judged> judged;
+    for (size_t i = 0; i < trace.size(); i++) {
+        SampleFrame frame;
+        frame.set(type, trace[i], i * 60000);
+
+        Judged result{ false, false, false };
+        detector.screen(frame, [&](const AnomalyReport& report) {
+            result.reported = true;
+            result.rejected = report.rejected;
+        });
+        result.kept = frame.has(type);
+        judged.push_back(result);
+    }
+    return judged;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_single_spike_is_rejected() {
+    AnomalyDetector detector;
+    const std::vector<Judged> judged = replay(detector, MeasurementType::CO2, co2_spike_trace);
+
+    for (size_t i = 0; i < judged.size(); i++) {
+        if (i == co2_spike_index) {
+            TEST_ASSERT_TRUE(judged[i].reported);
+            TEST_ASSERT_TRUE(judged[i].rejected);
+            TEST_ASSERT_FALSE(judged[i].kept);
+        } else {
+            TEST_ASSERT_FALSE(judged[i].reported);
+            TEST_ASSERT_TRUE(judged[i].kept);
+        }
+    }
+}
+
+void test_level_shift_is_accepted_once_it_fills_the_window() {
+    AnomalyDetector detector;
+    const std::vector<Judged> judged = replay(detector, MeasurementType::CO2, co2_shift_trace);
+
+    // The step is an outlier at first...
+    TEST_ASSERT_TRUE(judged[co2_shift_index].rejected);
+
+    // ...until the new level holds half the window, after which every sample is kept.
+    const size_t accepted_from = co2_shift_index + RobustZScore::window / 2 + 1;
+    for (size_t i = accepted_from; i < judged.size(); i++) {
+        TEST_ASSERT_FALSE(judged[i].reported);
+        TEST_ASSERT_TRUE(judged[i].kept);
+    }
+    for (size_t i = 0; i < co2_shift_index; i++) {
+        TEST_ASSERT_TRUE(judged[i].kept);
+    }
+}
+
+void test_pm_outliers_are_flagged_not_rejected() {
+    AnomalyDetector detector;
+    const std::vector<Judged> judged = replay(detector, MeasurementType::PM25, pm25_trace);
+
+    TEST_ASSERT_TRUE(judged[pm25_burst_index].reported);
+    TEST_ASSERT_FALSE(judged[pm25_burst_index].rejected);
+    for (const Judged& result : judged) {
+        TEST_ASSERT_TRUE(result.kept);
+    }
+}
+
+void test_nothing_is_judged_before_min_samples() {
+    // Wildly different values: each would be an outlier against the others.
+    const std::vector<double> warmup = { 400, 5000, 420, 4800, 410, 5100, 430, 5000 };
+
+    AnomalyDetector detector;
+    const std::vector<Judged> judged = replay(detector, MeasurementType::CO2, warmup);
+    TEST_ASSERT_EQUAL(7, RobustZScore::min_samples);
+    for (size_t i = 0; i < 7; i++) {
+        TEST_ASSERT_FALSE(judged[i].reported);
+        TEST_ASSERT_TRUE(judged[i].kept);
+    }
+
+    // The eighth sample is the first one scored.
+    float median = 0;
+    RobustZScore series;
+    for (size_t i = 0; i < 7; i++) {
+        TEST_ASSERT_EQUAL_INT(0, static_cast<int>(series.score(600, [](float) { return 10.0f; }, median)));
+    }
+    TEST_ASSERT_GREATER_THAN(AnomalyDetector::threshold, series.score(5000, [](float) { return 10.0f; }, median));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_single_spike_is_rejected);
+    RUN_TEST(test_level_shift_is_accepted_once_it_fills_the_window);
+    RUN_TEST(test_pm_outliers_are_flagged_not_rejected);
+    RUN_TEST(test_nothing_is_judged_before_min_samples);
+    return UNITY_END();
+}
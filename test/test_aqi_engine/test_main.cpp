@@ -0,0 +1,55 @@
+#include <unity.h>
+
+#include "AqiEngine.h"
+
+static constexpr uint32_t start_time = 1750000000 - 1750000000 % 3600;
+
+// One sample per minute, for minutes [first, first + count) after `start_time`.
+static void addSamples(AqiEngine& engine, double pm25, double pm10, uint32_t first, uint32_t count) {
+    SampleFrame frame;
+    frame.set(MeasurementType::PM25, pm25, 0);
+    frame.set(MeasurementType::PM10, pm10, 0);
+    for (uint32_t minute = first; minute < first + count; minute++) {
+        engine.add(frame, start_time + minute * 60);
+    }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_needs_two_of_the_last_three_hours() {
+    AqiEngine engine;
+    addSamples(engine, 20, 30, 0, 60);
+    TEST_ASSERT_FALSE(engine.summary(start_time + 59 * 60).valid);
+
+    addSamples(engine, 20, 30, 60, 1);
+    const AqiSummary summary = engine.summary(start_time + 60 * 60);
+    TEST_ASSERT_TRUE(summary.valid);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 20.0, summary.nowcast_pm25);
+    TEST_ASSERT_EQUAL_UINT16(71, summary.aqi);
+    TEST_ASSERT_EQUAL_UINT8(33, summary.caqi);
+}
+
+void test_stale_data_turns_invalid() {
+    AqiEngine engine;
+    addSamples(engine, 20, 30, 0, 180);
+    const uint32_t last_sample = start_time + 179 * 60;
+
+    TEST_ASSERT_TRUE(engine.summary(last_sample).valid);
+
+    // An hour without samples: the current hour is empty, so there is no CAQI.
+    const AqiSummary an_hour_later = engine.summary(last_sample + 3600);
+    TEST_ASSERT_TRUE(an_hour_later.valid);
+    TEST_ASSERT_EQUAL_UINT8(0, an_hour_later.caqi);
+
+    // Only one of the last three hours has data.
+    TEST_ASSERT_FALSE(engine.summary(last_sample + 2 * 3600).valid);
+    TEST_ASSERT_FALSE(engine.summary(last_sample + 48 * 3600).valid);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_needs_two_of_the_last_three_hours);
+    RUN_TEST(test_stale_data_turns_invalid);
+    return UNITY_END();
+}
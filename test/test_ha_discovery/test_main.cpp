@@ -0,0 +1,383 @@
+#include <unity.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ha/Manager.h"
+#include "ha/Sensor.h"
+
+static uint32_t now_ms = 1000;
+
+struct Message {
+    uint32_t time;
+    std::string topic;
+    std::string payload;
+};
+
+// Records what the manager publishes. Messages wait in `outbox` until flush(), or
+// reach the broker right away with `auto_flush`; a dropped connection loses them.
+class RecordingClient : public ha::MqttClient {
+public:
+    bool connected = true;
+    uint32_t connections = 1;
+    bool auto_flush = true;
+    uint32_t refuse_every = 0; // every n-th publish fails as if the outbox were full
+    uint32_t attempts = 0;
+    std::vector<Message> outbox;
+    std::vector<Message> delivered;
+
+    bool publish(std::string_view topic, std::string_view payload, bool) override {
+        if (!connected) return false;
+        if (refuse_every > 0 && ++attempts % refuse_every == 0) return false;
+        outbox.push_back(Message{ now_ms, std::string{topic}, std::string{payload} });
+        if (auto_flush) flush();
+        return true;
+    }
+
+    void subscribe(const std::string&) override {}
+    void setCallback(MessageCallback) override {}
+    bool isConnected() const override { return connected; }
+    uint32_t getConnectionCount() const override { return connections; }
+    bool isFlushed() const override { return outbox.empty(); }
+
+    void flush() {
+        delivered.insert(delivered.end(), outbox.begin(), outbox.end());
+        outbox.clear();
+    }
+
+    void drop() {
+        connected = false;
+        outbox.clear();
+    }
+
+    void reconnect() {
+        connected = true;
+        connections++;
+    }
+
+    size_t deliveredCount(const std::string& topic) const {
+        return std::count_if(delivered.begin(), delivered.end(), [&](const Message& m) { return m.topic == topic; });
+    }
+};
+
+struct Fixture {
+    std::shared_ptr<ha::Device> device = std::make_shared<ha::Device>("smaq_", "a1b2c3", "SMAQ", "1.0");
+    std::shared_ptr<RecordingClient> client = std::make_shared<RecordingClient>();
+    ha::Manager manager{ device, client };
+    std::vector<std::shared_ptr<ha::Sensor>> sensors;
+    std::vector<bool> saved_modes;
+
+    explicit Fixture(size_t sensor_count = 4) {
+        manager.setDiscoveryPrefix("homeassistant");
+        manager.setDiscoveryModeCallback([this](bool device_discovery) { saved_modes.push_back(device_discovery); });
+        for (size_t i = 0; i < sensor_count; i++) {
+            addSensor("sensor" + std::to_string(i), "Sensor " + std::to_string(i));
+        }
+    }
+
+    void addSensor(const std::string& id, const std::string& name) {
+        auto sensor = std::make_shared<ha::Sensor>(*device, id, name, "temperature", "°C");
+        sensor->enableAttributes();
+        sensor->updateState("21.5");
+        manager.addComponent(sensor);
+        sensors.push_back(sensor);
+    }
+
+    // Calls reportState() every 10 ms of virtual time for `duration` ms.
+    void run(uint32_t duration) {
+        for (uint32_t end = now_ms + duration; now_ms < end; now_ms += 10) {
+            manager.reportState();
+        }
+    }
+
+    bool everyConfigDelivered() const {
+        for (const auto& sensor : sensors) {
+            if (client->deliveredCount(sensor->getDiscoveryTopic()) == 0) return false;
+        }
+        return true;
+    }
+
+    size_t stateMessages() const {
+        return client->deliveredCount(sensors.front()->getStateTopic());
+    }
+
+    std::string deviceTopic() const {
+        return "homeassistant/device/" + std::string{device->getDeviceId()} + "/config";
+    }
+
+    // The delivered discovery messages as "<topic> <payload>", with the configs
+    // themselves shortened to "config".
+    std::vector<std::string> discoveryLog() const {
+        std::vector<std::string> log;
+        for (const Message& m : client->delivered) {
+            if (m.topic.size() < 7 || m.topic.compare(m.topic.size() - 7, 7, "/config") != 0) continue;
+            const bool config = !m.payload.empty() && m.payload != migrate;
+            log.push_back(m.topic + " " + (config ? std::string{"config"} : m.payload));
+        }
+        return log;
+    }
+
+    static constexpr const char* migrate = "{\"migrate_discovery\":true}";
+};
+
+static void assertLog(const std::vector<std::string>& expected, const std::vector<std::string>& actual) {
+    TEST_ASSERT_EQUAL(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        TEST_ASSERT_EQUAL_STRING(expected[i].c_str(), actual[i].c_str());
+    }
+}
+
+// What a switch from per-entity to device discovery has to leave on the broker, in order.
+static std::vector<std::string> migrationToDevice(const Fixture& f) {
+    std::vector<std::string> log;
+    for (const auto& sensor : f.sensors) log.push_back(sensor->getDiscoveryTopic() + " " + Fixture::migrate);
+    log.push_back(f.deviceTopic() + " config");
+    for (const auto& sensor : f.sensors) log.push_back(sensor->getDiscoveryTopic() + " ");
+    return log;
+}
+
+void setUp() {
+    now_ms = 1000;
+    host_millis_source = &now_ms;
+}
+
+void tearDown() {
+    host_millis_source = nullptr;
+}
+
+// ── Delivery ──
+
+void test_discovery_finishes_only_after_the_client_flushed() {
+    Fixture f;
+    f.client->auto_flush = false;
+    f.run(2000);
+
+    // Everything is queued, but nothing has been written yet.
+    TEST_ASSERT_EQUAL(f.sensors.size(), f.client->outbox.size());
+    TEST_ASSERT_EQUAL(0, f.client->delivered.size());
+    TEST_ASSERT_EQUAL(0, f.manager.getLastDiscoveryMillis());
+
+    f.client->flush();
+    f.client->auto_flush = true;
+    f.run(10);
+    TEST_ASSERT_TRUE(f.everyConfigDelivered());
+    TEST_ASSERT_GREATER_OR_EQUAL(2000, f.manager.getLastDiscoveryMillis());
+    TEST_ASSERT_EQUAL(1, f.stateMessages());
+}
+
+void test_configs_are_resent_when_the_connection_drops_before_the_flush() {
+    Fixture f;
+    f.client->auto_flush = false;
+    f.run(2000);
+    TEST_ASSERT_EQUAL(f.sensors.size(), f.client->outbox.size());
+
+    f.client->drop();
+    f.run(100);
+    f.client->reconnect();
+    f.client->auto_flush = true;
+    f.run(2000);
+
+    TEST_ASSERT_TRUE(f.everyConfigDelivered());
+    TEST_ASSERT_GREATER_THAN(0, f.manager.getLastDiscoveryMillis());
+}
+
+void test_a_reconnect_between_two_reports_restarts_discovery() {
+    Fixture f;
+    f.client->auto_flush = false;
+    f.run(2000);
+
+    // The connection drops and comes back without the manager seeing it down.
+    f.client->drop();
+    f.client->reconnect();
+    f.client->auto_flush = true;
+    f.run(2000);
+
+    TEST_ASSERT_TRUE(f.everyConfigDelivered());
+    TEST_ASSERT_EQUAL(1, f.stateMessages());
+}
+
+void test_flushed_configs_are_not_resent_after_a_reconnect() {
+    Fixture f;
+    f.run(2000);
+    TEST_ASSERT_TRUE(f.everyConfigDelivered());
+    const size_t discovery_messages = f.client->delivered.size() - f.stateMessages();
+
+    f.client->drop();
+    f.run(100);
+    f.client->reconnect();
+    f.run(2000);
+
+    TEST_ASSERT_EQUAL(discovery_messages, f.client->delivered.size() - f.stateMessages());
+    TEST_ASSERT_EQUAL(2, f.stateMessages());
+}
+
+// ── Discovery modes ──
+
+void test_switching_to_device_discovery_migrates_once() {
+    Fixture f;
+    f.manager.setDeviceDiscovery(true, false);
+    f.run(2000);
+    assertLog(migrationToDevice(f), f.discoveryLog());
+    TEST_ASSERT_EQUAL(1, f.saved_modes.size());
+    TEST_ASSERT_TRUE(f.saved_modes[0]);
+
+    // Home Assistant restarting gets the device config again, but no second migration.
+    f.client->delivered.clear();
+    f.manager.restartDiscovery();
+    f.run(2000);
+    assertLog({ f.deviceTopic() + " config" }, f.discoveryLog());
+    TEST_ASSERT_EQUAL(1, f.saved_modes.size());
+}
+
+void test_switching_back_to_entity_discovery_clears_the_device_config() {
+    Fixture f;
+    f.manager.setDeviceDiscovery(false, true);
+    f.run(2000);
+
+    std::vector<std::string> expected = { f.deviceTopic() + " " + Fixture::migrate };
+    for (const auto& sensor : f.sensors) expected.push_back(sensor->getDiscoveryTopic() + " config");
+    expected.push_back(f.deviceTopic() + " ");
+    assertLog(expected, f.discoveryLog());
+    TEST_ASSERT_EQUAL(1, f.saved_modes.size());
+    TEST_ASSERT_FALSE(f.saved_modes[0]);
+}
+
+void test_unchanged_mode_sends_no_migration() {
+    Fixture entity;
+    entity.manager.setDeviceDiscovery(false, false);
+    entity.run(2000);
+    std::vector<std::string> expected;
+    for (const auto& sensor : entity.sensors) expected.push_back(sensor->getDiscoveryTopic() + " config");
+    assertLog(expected, entity.discoveryLog());
+    TEST_ASSERT_EQUAL(0, entity.saved_modes.size());
+
+    Fixture device;
+    device.manager.setDeviceDiscovery(true, true);
+    device.run(2000);
+    assertLog({ device.deviceTopic() + " config" }, device.discoveryLog());
+    TEST_ASSERT_EQUAL(0, device.saved_modes.size());
+}
+
+void test_mode_is_saved_only_after_the_migration_was_flushed() {
+    Fixture f;
+    f.manager.setDeviceDiscovery(true, false);
+    f.client->auto_flush = false;
+    f.run(2000);
+    TEST_ASSERT_EQUAL(2 * f.sensors.size() + 1, f.client->outbox.size());
+    TEST_ASSERT_EQUAL(0, f.saved_modes.size());
+
+    f.client->flush();
+    f.run(10);
+    TEST_ASSERT_EQUAL(1, f.saved_modes.size());
+}
+
+void test_interrupted_migration_is_repeated_after_reconnect() {
+    Fixture f;
+    f.manager.setDeviceDiscovery(true, false);
+    f.client->auto_flush = false;
+    f.run(2000);
+
+    f.client->drop();
+    f.run(100);
+    TEST_ASSERT_EQUAL(0, f.saved_modes.size());
+
+    f.client->reconnect();
+    f.client->auto_flush = true;
+    f.run(2000);
+    assertLog(migrationToDevice(f), f.discoveryLog());
+    TEST_ASSERT_EQUAL(1, f.saved_modes.size());
+}
+
+// ── Pacing ──
+
+static bool isConfig(const Fixture& f, const Message& message) {
+    return message.topic != f.sensors.front()->getStateTopic();
+}
+
+// Token bucket bound: any run of configs costs at most one full budget plus the refill over its span.
+static void assertWithinBudget(const Fixture& f) {
+    constexpr uint64_t budget = ha::Manager::discovery_bytes_per_second;
+    std::vector<Message> configs;
+    for (const Message& m : f.client->delivered) {
+        if (isConfig(f, m)) configs.push_back(m);
+    }
+
+    for (size_t first = 0; first < configs.size(); first++) {
+        uint64_t cost = 0;
+        for (size_t last = first; last < configs.size(); last++) {
+            cost += std::min<uint64_t>(configs[last].payload.size(), budget);
+            const uint64_t span = configs[last].time - configs[first].time;
+            TEST_ASSERT_LESS_OR_EQUAL(budget * 1000 + budget * span, cost * 1000);
+        }
+    }
+}
+
+// Every sensor's config delivered exactly once, in the order the sensors were added.
+static void assertEachConfigOnceInOrder(const Fixture& f) {
+    std::vector<std::string> topics;
+    for (const Message& m : f.client->delivered) {
+        if (isConfig(f, m)) topics.push_back(m.topic);
+    }
+    TEST_ASSERT_EQUAL(f.sensors.size(), topics.size());
+    for (size_t i = 0; i < f.sensors.size(); i++) {
+        TEST_ASSERT_EQUAL_STRING(f.sensors[i]->getDiscoveryTopic().c_str(), topics[i].c_str());
+    }
+}
+
+void test_discovery_stays_within_the_byte_budget() {
+    Fixture f(24);
+    f.run(20000);
+
+    assertEachConfigOnceInOrder(f);
+    assertWithinBudget(f);
+
+    // More than a budget's worth of configs can't go out in one go.
+    size_t total = 0;
+    for (const Message& m : f.client->delivered) {
+        if (isConfig(f, m)) total += m.payload.size();
+    }
+    TEST_ASSERT_GREATER_THAN(2 * ha::Manager::discovery_bytes_per_second, total);
+    const uint32_t min_millis = (total - ha::Manager::discovery_bytes_per_second) * 1000 / ha::Manager::discovery_bytes_per_second;
+    TEST_ASSERT_GREATER_OR_EQUAL(min_millis, f.manager.getLastDiscoveryMillis());
+}
+
+void test_oversized_config_goes_out_on_a_full_budget() {
+    Fixture f(6);
+    f.addSensor("oversized", std::string(ha::Manager::discovery_bytes_per_second + 1000, 'x'));
+    f.addSensor("after", "After");
+    f.run(20000);
+
+    assertEachConfigOnceInOrder(f);
+    assertWithinBudget(f);
+    TEST_ASSERT_EQUAL(1, f.stateMessages());
+}
+
+void test_refused_publishes_resume_where_they_stopped() {
+    Fixture f(12);
+    f.client->refuse_every = 3;
+    f.run(40000);
+
+    assertEachConfigOnceInOrder(f);
+    assertWithinBudget(f);
+    // A refused state report is retried with the next one.
+    TEST_ASSERT_GREATER_OR_EQUAL(1, f.stateMessages());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_discovery_finishes_only_after_the_client_flushed);
+    RUN_TEST(test_configs_are_resent_when_the_connection_drops_before_the_flush);
+    RUN_TEST(test_a_reconnect_between_two_reports_restarts_discovery);
+    RUN_TEST(test_flushed_configs_are_not_resent_after_a_reconnect);
+    RUN_TEST(test_switching_to_device_discovery_migrates_once);
+    RUN_TEST(test_switching_back_to_entity_discovery_clears_the_device_config);
+    RUN_TEST(test_unchanged_mode_sends_no_migration);
+    RUN_TEST(test_mode_is_saved_only_after_the_migration_was_flushed);
+    RUN_TEST(test_interrupted_migration_is_repeated_after_reconnect);
+    RUN_TEST(test_discovery_stays_within_the_byte_budget);
+    RUN_TEST(test_oversized_config_goes_out_on_a_full_budget);
+    RUN_TEST(test_refused_publishes_resume_where_they_stopped);
+    return UNITY_END();
+}
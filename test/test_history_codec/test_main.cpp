@@ -0,0 +1,172 @@
+#include <unity.h>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "HistoryCodec.h"
+
+// Same body size as a HistoryLog page.
+static constexpr size_t block_size = 240;
+
+struct Block {
+    std::array<uint8_t, block_size> data{};
+    size_t bit_count = 0;
+    uint16_t record_count = 0;
+};
+
+// Minute records with every sensor doing a random walk, occasional gaps and a sensor dropping out now and then.
+static std::vector<HistoryRecord> makeRecords(size_t count, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> step(0, 1);
+    std::vector<HistoryRecord> records(count);
+
+    uint32_t time = 1750000020;
+    float temperature = 21, humidity = 45, pm1 = 4, pm25 = 7, pm10 = 9, co2 = 600;
+    for (HistoryRecord& record : records) {
+        time += rng() % 50 == 0 ? 60 * (2 + rng() % 30) : 60;
+        temperature += 0.03f * step(rng);
+        humidity += 0.2f * step(rng);
+        pm1 = std::max(0.0f, pm1 + step(rng));
+        pm25 = std::max(pm1, pm25 + step(rng));
+        pm10 = std::max(pm25, pm10 + step(rng));
+        co2 = std::max(400.0f, co2 + 8 * step(rng));
+
+        record.time = time;
+        record.valid_mask = rng() % 40 == 0 ? 0x23 : 0x3F;
+        const float values[] = { temperature, humidity, pm1, pm25, pm10, co2 };
+        for (size_t index = 0; index < measurement_type_count; index++) {
+            const MeasurementType type = static_cast<MeasurementType>(index);
+            // Stored precision, as the sensors report it.
+            record.values[index] = record.has(type) ? history_codec::dequantize(type, history_codec::quantize(type, values[index])) : 0;
+        }
+    }
+    return records;
+}
+
+static std::vector<Block> encode(const std::vector<HistoryRecord>& records) {
+    std::vector<Block> blocks(1);
+    HistoryBlockEncoder encoder(blocks.back().data.data(), block_size);
+    for (const HistoryRecord& record : records) {
+        if (encoder.append(record)) continue;
+        blocks.back().bit_count = encoder.bitCount();
+        blocks.back().record_count = encoder.recordCount();
+        blocks.emplace_back();
+        encoder = HistoryBlockEncoder(blocks.back().data.data(), block_size);
+        encoder.append(record);
+    }
+    blocks.back().bit_count = encoder.bitCount();
+    blocks.back().record_count = encoder.recordCount();
+    return blocks;
+}
+
+static std::vector<HistoryRecord> decode(const std::vector<Block>& blocks) {
+    std::vector<HistoryRecord> records;
+    HistoryBlockDecoder decoder;
+    HistoryRecord record;
+    for (const Block& block : blocks) {
+        decoder.reset(block.data.data(), block.bit_count, block.record_count);
+        while (decoder.next(record)) records.push_back(record);
+    }
+    return records;
+}
+
+static bool sameRecords(const std::vector<HistoryRecord>& expected, const std::vector<HistoryRecord>& actual) {
+    if (expected.size() != actual.size()) return false;
+    for (size_t i = 0; i < expected.size(); i++) {
+        if (expected[i].time != actual[i].time || expected[i].valid_mask != actual[i].valid_mask) return false;
+        for (size_t index = 0; index < measurement_type_count; index++) {
+            const MeasurementType type = static_cast<MeasurementType>(index);
+            if (!expected[i].has(type)) continue;
+            if (history_codec::quantize(type, expected[i].values[index]) != history_codec::quantize(type, actual[i].values[index])) return false;
+        }
+    }
+    return true;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_round_trip_is_exact_at_stored_precision() {
+    const std::vector<HistoryRecord> records = makeRecords(20000, 1);
+    const std::vector<Block> blocks = encode(records);
+    TEST_ASSERT_TRUE(sameRecords(records, decode(blocks)));
+
+    const double per_block = static_cast<double>(records.size()) / blocks.size();
+    char message[96];
+    snprintf(message, sizeof(message), "History codec: %.1f records per %u-byte block, %.2f bytes per record",
+             per_block, static_cast<unsigned>(block_size), block_size / per_block);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_GREATER_THAN(40.0, per_block);
+}
+
+void test_round_trip_of_extremes() {
+    std::vector<HistoryRecord> records(6);
+    const uint32_t times[] = { 0, 60, 1750000000, 1750000060, 1749999000, 0xFFFFFFF0u };
+    for (size_t i = 0; i < records.size(); i++) {
+        records[i].time = times[i];
+        records[i].valid_mask = i % 2 ? 0x3F : 0x01;
+        for (size_t index = 0; index < measurement_type_count; index++) {
+            records[i].values[index] = i % 2 ? 5000.0f : -40.0f;
+        }
+    }
+    const std::vector<Block> blocks = encode(records);
+    TEST_ASSERT_EQUAL(1, blocks.size());
+    TEST_ASSERT_TRUE(sameRecords(records, decode(blocks)));
+}
+
+void test_full_block_rejects_record_unchanged() {
+    const std::vector<HistoryRecord> records = makeRecords(200, 2);
+    Block block;
+    HistoryBlockEncoder encoder(block.data.data(), block_size);
+    size_t accepted = 0;
+    while (accepted < records.size() && encoder.append(records[accepted])) accepted++;
+    TEST_ASSERT_LESS_THAN(records.size(), accepted);
+
+    const size_t bits = encoder.bitCount();
+    const std::array<uint8_t, block_size> before = block.data;
+    TEST_ASSERT_FALSE(encoder.append(records[accepted]));
+    TEST_ASSERT_EQUAL(bits, encoder.bitCount());
+    TEST_ASSERT_EQUAL(accepted, encoder.recordCount());
+    TEST_ASSERT_EQUAL_MEMORY(before.data(), block.data.data(), block_size);
+}
+
+void test_truncated_block_stops_decoding() {
+    const std::vector<HistoryRecord> records = makeRecords(30, 3);
+    std::vector<Block> blocks = encode(records);
+    TEST_ASSERT_EQUAL(1, blocks.size());
+
+    blocks[0].bit_count /= 2;
+    const std::vector<HistoryRecord> decoded = decode(blocks);
+    TEST_ASSERT_LESS_THAN(records.size(), decoded.size());
+    TEST_ASSERT_TRUE(sameRecords(std::vector<HistoryRecord>(records.begin(), records.begin() + decoded.size()), decoded));
+}
+
+void test_throughput() {
+    const std::vector<HistoryRecord> records = makeRecords(200000, 4);
+
+    const auto encode_start = std::chrono::steady_clock::now();
+    const std::vector<Block> blocks = encode(records);
+    const auto decode_start = std::chrono::steady_clock::now();
+    const std::vector<HistoryRecord> decoded = decode(blocks);
+    const auto end = std::chrono::steady_clock::now();
+
+    TEST_ASSERT_EQUAL(records.size(), decoded.size());
+    const double encode_seconds = std::chrono::duration<double>(decode_start - encode_start).count();
+    const double decode_seconds = std::chrono::duration<double>(end - decode_start).count();
+    char message[96];
+    snprintf(message, sizeof(message), "History codec: encode %.1f M records/s, decode %.1f M records/s",
+             records.size() / encode_seconds / 1e6, records.size() / decode_seconds / 1e6);
+    TEST_MESSAGE(message);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip_is_exact_at_stored_precision);
+    RUN_TEST(test_round_trip_of_extremes);
+    RUN_TEST(test_full_block_rejects_record_unchanged);
+    RUN_TEST(test_truncated_block_stops_decoding);
+    RUN_TEST(test_throughput);
+    return UNITY_END();
+}
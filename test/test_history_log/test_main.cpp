@@ -0,0 +1,213 @@
+#include <unity.h>
+
+#include <cstring>
+#include <vector>
+
+#include "HistoryLog.h"
+
+// NOR flash in RAM: erase sets a sector to 0xFF, writes can only clear bits.
+// Writes can be made to fail, or to stop part way as if power was lost.
+class EmulatedFlash : public FlashRegion {
+public:
+    std::vector<uint8_t> data;
+    std::vector<uint32_t> erase_counts;
+    int failing_writes = 0;
+    size_t torn_write_length = 0; // bytes that reach flash in the next write, 0 for all
+
+    explicit EmulatedFlash(size_t sectors)
+        : data(sectors * sector_size, 0xFF)
+        , erase_counts(sectors, 0) {
+    }
+
+    size_t size() const override {
+        return data.size();
+    }
+
+    bool read(size_t offset, void* dest, size_t length) override {
+        if (offset + length > data.size()) return false;
+        std::memcpy(dest, &data[offset], length);
+        return true;
+    }
+
+    bool write(size_t offset, const void* src, size_t length) override {
+        if (offset + length > data.size()) return false;
+        if (failing_writes > 0) {
+            failing_writes--;
+            return false;
+        }
+        if (torn_write_length > 0) {
+            length = torn_write_length;
+            torn_write_length = 0;
+        }
+        const uint8_t* bytes = static_cast<const uint8_t*>(src);
+        for (size_t i = 0; i < length; i++) data[offset + i] &= bytes[i];
+        return true;
+    }
+
+    bool eraseSector(size_t offset) override {
+        if (offset % sector_size != 0 || offset >= data.size()) return false;
+        std::memset(&data[offset], 0xFF, sector_size);
+        erase_counts[offset / sector_size]++;
+        return true;
+    }
+};
+
+static constexpr uint32_t start_time = 1750000020 - 1750000020 % HistoryLog::record_interval_seconds;
+static constexpr size_t records_per_page = 3;
+
+// Appends one record per minute, starting at record number `first`, and writes them as one page.
+static void writePage(HistoryLog& log, uint32_t first) {
+    for (uint32_t i = first; i < first + records_per_page; i++) {
+        SampleFrame frame;
+        frame.set(MeasurementType::Temperature, 20 + (i % 50) * 0.1, 0);
+        frame.set(MeasurementType::CO2, 400 + i % 300, 0);
+        log.append(frame, start_time + i * HistoryLog::record_interval_seconds);
+    }
+    log.sync();
+}
+
+static void writePages(HistoryLog& log, uint32_t first_page, uint32_t count) {
+    for (uint32_t page = first_page; page < first_page + count; page++) {
+        writePage(log, page * records_per_page);
+    }
+}
+
+// Record numbers of everything the log returns, oldest first.
+static std::vector<uint32_t> readAll(HistoryLog& log) {
+    std::vector<uint32_t> numbers;
+    HistoryLog::Reader reader = log.read(0);
+    HistoryLog::Record record;
+    while (reader.next(record)) {
+        numbers.push_back((record.time - start_time) / HistoryLog::record_interval_seconds);
+    }
+    return numbers;
+}
+
+static bool isSequence(const std::vector<uint32_t>& numbers, uint32_t first, uint32_t count) {
+    if (numbers.size() != count) return false;
+    for (uint32_t i = 0; i < count; i++) {
+        if (numbers[i] != first + i) return false;
+    }
+    return true;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_recovers_from_highest_sequence() {
+    EmulatedFlash flash(2);
+    {
+        HistoryLog log(flash);
+        TEST_ASSERT_TRUE(log.begin());
+        writePages(log, 0, 5);
+        TEST_ASSERT_EQUAL_UINT32(5, log.getStats().pages_written);
+    }
+
+    HistoryLog log(flash);
+    TEST_ASSERT_TRUE(log.begin());
+    HistoryLog::Stats stats = log.getStats();
+    TEST_ASSERT_EQUAL(5, stats.head_page);
+    TEST_ASSERT_EQUAL_UINT32(6, stats.next_sequence);
+    TEST_ASSERT_EQUAL(32, stats.page_count);
+    TEST_ASSERT_TRUE(isSequence(readAll(log), 0, 5 * records_per_page));
+
+    HistoryLog::Reader reader = log.read(0);
+    HistoryLog::Record record;
+    TEST_ASSERT_TRUE(reader.next(record));
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 20.0, record.values[static_cast<size_t>(MeasurementType::Temperature)]);
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 400.0, record.values[static_cast<size_t>(MeasurementType::CO2)]);
+
+    writePages(log, 5, 1);
+    TEST_ASSERT_TRUE(isSequence(readAll(log), 0, 6 * records_per_page));
+}
+
+void test_skips_torn_and_corrupted_pages() {
+    EmulatedFlash flash(2);
+    {
+        HistoryLog log(flash);
+        log.begin();
+        writePages(log, 0, 3);
+        // Power lost while the fourth page was being programmed.
+        flash.torn_write_length = 20;
+        writePages(log, 3, 1);
+    }
+    // A bit flipped in the body of the second page.
+    flash.data[HistoryLog::page_size + 18] ^= 0x10;
+
+    HistoryLog log(flash);
+    log.begin();
+    TEST_ASSERT_EQUAL(3, log.getStats().head_page);
+    TEST_ASSERT_EQUAL_UINT32(4, log.getStats().next_sequence);
+
+    std::vector<uint32_t> numbers = readAll(log);
+    TEST_ASSERT_EQUAL(2 * records_per_page, numbers.size());
+    TEST_ASSERT_EQUAL(0, numbers[0]);
+    TEST_ASSERT_EQUAL(2 * records_per_page, numbers[records_per_page]);
+
+    // The torn page can't be programmed again before its sector is erased, so it is skipped.
+    writePages(log, 4, 1);
+    TEST_ASSERT_EQUAL(5, log.getStats().head_page);
+    numbers = readAll(log);
+    TEST_ASSERT_EQUAL(3 * records_per_page, numbers.size());
+    TEST_ASSERT_EQUAL(5 * records_per_page - 1, numbers.back());
+}
+
+void test_wraps_around_and_recycles_oldest_sector() {
+    EmulatedFlash flash(2);
+    HistoryLog log(flash);
+    log.begin();
+    writePages(log, 0, 40);
+
+    // Re-entering sector 0 erased pages 0-15; pages 16-31 and the 8 new ones remain.
+    TEST_ASSERT_EQUAL(8, log.getStats().head_page);
+    TEST_ASSERT_TRUE(isSequence(readAll(log), 16 * records_per_page, 24 * records_per_page));
+
+    HistoryLog recovered(flash);
+    recovered.begin();
+    TEST_ASSERT_EQUAL(8, recovered.getStats().head_page);
+    TEST_ASSERT_EQUAL_UINT32(41, recovered.getStats().next_sequence);
+    TEST_ASSERT_TRUE(isSequence(readAll(recovered), 16 * records_per_page, 24 * records_per_page));
+}
+
+void test_erases_each_sector_once_per_lap() {
+    EmulatedFlash flash(3);
+    HistoryLog log(flash);
+    log.begin();
+
+    writePages(log, 0, 1);
+    TEST_ASSERT_EQUAL_UINT32(1, flash.erase_counts[0]);
+    TEST_ASSERT_EQUAL_UINT32(0, flash.erase_counts[1]);
+
+    writePages(log, 1, 3 * 48 - 1);
+    for (uint32_t count : flash.erase_counts) TEST_ASSERT_EQUAL_UINT32(3, count);
+}
+
+void test_retries_a_failed_page_write() {
+    EmulatedFlash flash(2);
+    HistoryLog log(flash);
+    log.begin();
+
+    flash.failing_writes = 1;
+    writePages(log, 0, 1);
+    TEST_ASSERT_EQUAL_UINT32(1, log.getStats().write_errors);
+    TEST_ASSERT_EQUAL_UINT32(0, log.getStats().pages_written);
+    TEST_ASSERT_TRUE(isSequence(readAll(log), 0, records_per_page));
+
+    log.flush();
+    TEST_ASSERT_EQUAL_UINT32(1, log.getStats().pages_written);
+    TEST_ASSERT_EQUAL_UINT32(0, log.getStats().dropped_pages);
+
+    HistoryLog recovered(flash);
+    recovered.begin();
+    TEST_ASSERT_TRUE(isSequence(readAll(recovered), 0, records_per_page));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_recovers_from_highest_sequence);
+    RUN_TEST(test_skips_torn_and_corrupted_pages);
+    RUN_TEST(test_wraps_around_and_recycles_oldest_sector);
+    RUN_TEST(test_erases_each_sector_once_per_lap);
+    RUN_TEST(test_retries_a_failed_page_write);
+    return UNITY_END();
+}
@@ -0,0 +1,145 @@
+#include <unity.h>
+
+#include <string>
+#include <vector>
+
+#include "HistoryJsonStream.h"
+
+static constexpr uint32_t start_time = 1750000000;
+
+// `count` frames of temperature and humidity, `step` seconds apart.
+static void addSamples(HistoryStore& store, uint32_t count, uint32_t step) {
+    for (uint32_t i = 0; i < count; i++) {
+        SampleFrame frame;
+        frame.set(MeasurementType::Temperature, 20.0 + (i % 17) * 0.25, 0);
+        frame.set(MeasurementType::Humidity, 40.0 + (i % 5), 0);
+        store.add(frame, start_time + i * step);
+    }
+}
+
+// The body the handler used to print in one go while holding the store lock.
+static std::string expectedJson(const HistoryStore& store, MeasurementType type, HistoryResolution resolution,
+                                const char* resolution_name, uint32_t from, uint32_t points) {
+    const std::string_view name = ApiNameTypeTranslator().translate(type);
+    std::string json = "{\"type\":\"" + std::string(name) + "\",\"res\":\"" + resolution_name + "\",\"points\":[";
+    bool first = true;
+    auto print_point = [&](const HistoryPoint& point) {
+        char line[96];
+        snprintf(line, sizeof(line), "%s[%u,%.2f,%.2f,%.2f,%u]", first ? "" : ",",
+                 static_cast<unsigned>(point.time), point.min, point.max, point.mean, static_cast<unsigned>(point.count));
+        json += line;
+        first = false;
+    };
+
+    uint32_t oldest = 0;
+    uint32_t newest = 0;
+    if (points == 0) {
+        store.forEach(type, resolution, from, print_point);
+    } else if (store.span(resolution, oldest, newest)) {
+        HistoryDownsampler downsampler(std::max(from, oldest), newest, points);
+        store.forEach(type, resolution, from, [&](const HistoryPoint& point) {
+            downsampler.add(point, print_point);
+        });
+        downsampler.finish(print_point);
+    }
+    return json + "]}";
+}
+
+static std::string drain(HistoryJsonStream& stream, size_t chunk_size) {
+    std::string json;
+    std::vector<uint8_t> buffer(chunk_size);
+    while (size_t n = stream.fill(buffer.data(), buffer.size())) {
+        json.append(reinterpret_cast<const char*>(buffer.data()), n);
+    }
+    return json;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_raw_matches_unchunked_output() {
+    HistoryStore store;
+    addSamples(store, 200, 10);
+
+    for (size_t chunk_size : { 1, 7, 64, 1436 }) {
+        HistoryJsonStream stream(store, MeasurementType::Temperature, HistoryResolution::Raw, "raw", 0, 0);
+        TEST_ASSERT_EQUAL_STRING(expectedJson(store, MeasurementType::Temperature, HistoryResolution::Raw, "raw", 0, 0).c_str(),
+                                 drain(stream, chunk_size).c_str());
+    }
+}
+
+void test_from_skips_older_points() {
+    HistoryStore store;
+    addSamples(store, 100, 10);
+
+    const uint32_t from = start_time + 500;
+    HistoryJsonStream stream(store, MeasurementType::Humidity, HistoryResolution::Raw, "raw", from, 0);
+    TEST_ASSERT_EQUAL_STRING(expectedJson(store, MeasurementType::Humidity, HistoryResolution::Raw, "raw", from, 0).c_str(),
+                             drain(stream, 64).c_str());
+}
+
+void test_downsampled_matches_unchunked_output() {
+    HistoryStore store;
+    addSamples(store, 3000, 5);
+
+    for (uint32_t points : { 1, 10, 100, 1000 }) {
+        HistoryJsonStream stream(store, MeasurementType::Temperature, HistoryResolution::OneMinute, "1m", 0, points);
+        TEST_ASSERT_EQUAL_STRING(
+            expectedJson(store, MeasurementType::Temperature, HistoryResolution::OneMinute, "1m", 0, points).c_str(),
+            drain(stream, 100).c_str());
+    }
+}
+
+void test_empty_store() {
+    HistoryStore store;
+    HistoryJsonStream raw(store, MeasurementType::CO2, HistoryResolution::Raw, "raw", 0, 0);
+    TEST_ASSERT_EQUAL_STRING("{\"type\":\"co2\",\"res\":\"raw\",\"points\":[]}", drain(raw, 16).c_str());
+
+    HistoryJsonStream downsampled(store, MeasurementType::CO2, HistoryResolution::FifteenMinutes, "15m", 0, 50);
+    TEST_ASSERT_EQUAL_STRING("{\"type\":\"co2\",\"res\":\"15m\",\"points\":[]}", drain(downsampled, 16).c_str());
+}
+
+void test_samples_added_while_streaming() {
+    HistoryStore store;
+    addSamples(store, 10, 10);
+
+    HistoryJsonStream stream(store, MeasurementType::Temperature, HistoryResolution::Raw, "raw", 0, 0);
+    uint8_t buffer[40];
+    TEST_ASSERT_TRUE(stream.fill(buffer, sizeof(buffer)) > 0);
+
+    // Newer samples show up in the rest of the response, nothing is repeated.
+    SampleFrame frame;
+    frame.set(MeasurementType::Temperature, 30.0, 0);
+    store.add(frame, start_time + 1000);
+
+    const std::string json = std::string(reinterpret_cast<const char*>(buffer), sizeof(buffer)) + drain(stream, 64);
+    TEST_ASSERT_EQUAL_STRING(expectedJson(store, MeasurementType::Temperature, HistoryResolution::Raw, "raw", 0, 0).c_str(),
+                             json.c_str());
+}
+
+void test_samples_before_clock_sync_are_ignored() {
+    HistoryStore store;
+    SampleFrame frame;
+    frame.set(MeasurementType::Temperature, 21.0, 0);
+    store.add(frame, 42);
+
+    uint32_t first = 0;
+    uint32_t last = 0;
+    TEST_ASSERT_FALSE(store.span(HistoryResolution::Raw, first, last));
+    TEST_ASSERT_FALSE(store.span(HistoryResolution::OneMinute, first, last));
+
+    store.add(frame, start_time);
+    TEST_ASSERT_TRUE(store.span(HistoryResolution::OneMinute, first, last));
+    TEST_ASSERT_EQUAL_UINT32(start_time - start_time % 60, first);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_raw_matches_unchunked_output);
+    RUN_TEST(test_from_skips_older_points);
+    RUN_TEST(test_downsampled_matches_unchunked_output);
+    RUN_TEST(test_empty_store);
+    RUN_TEST(test_samples_added_while_streaming);
+    RUN_TEST(test_samples_before_clock_sync_are_ignored);
+    return UNITY_END();
+}
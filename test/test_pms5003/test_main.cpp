@@ -0,0 +1,200 @@
+#include <unity.h>
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "PMS5003Parser.h"
+#include "SpscRing.h"
+
+using Ring = SpscRing<256>;
+
+static std::vector<uint8_t> makeFrame(uint16_t pm25) {
+    std::vector<uint8_t> frame(PMS5003Parser::frame_length, 0);
+    frame[0] = 0x42;
+    frame[1] = 0x4D;
+    frame[3] = PMS5003Parser::frame_length - 4;
+    const uint16_t words[13] = { 1, pm25, 3, 4, static_cast<uint16_t>(pm25 + 1), 6, 700, 300, 60, 10, 2, 1, 0x9700 };
+    for (size_t i = 0; i < 13; i++) {
+        frame[4 + 2 * i] = words[i] >> 8;
+        frame[5 + 2 * i] = words[i] & 0xFF;
+    }
+    uint16_t sum = 0;
+    for (size_t i = 0; i < PMS5003Parser::frame_length - 2; i++) sum += frame[i];
+    frame[30] = sum >> 8;
+    frame[31] = sum & 0xFF;
+    return frame;
+}
+
+static void append(std::vector<uint8_t>& stream, const std::vector<uint8_t>& bytes) {
+    stream.insert(stream.end(), bytes.begin(), bytes.end());
+}
+
+// Pushes `stream` through the ring in chunks of `chunk` bytes, parsing after each one.
+static std::vector<PMS5003Frame> feed(PMS5003Parser& parser, const std::vector<uint8_t>& stream, size_t chunk) {
+    Ring ring;
+    std::vector<PMS5003Frame> frames;
+    PMS5003Frame frame{};
+    for (size_t offset = 0; offset < stream.size(); offset += chunk) {
+        const size_t length = std::min(chunk, stream.size() - offset);
+        ring.write(&stream[offset], length);
+        while (parser.parse(ring, frame)) frames.push_back(frame);
+    }
+    return frames;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_decodes_a_frame() {
+    PMS5003Parser parser;
+    const auto frames = feed(parser, makeFrame(25), 64);
+
+    TEST_ASSERT_EQUAL(1, frames.size());
+    TEST_ASSERT_EQUAL_UINT16(1, frames[0].pm_standard[0]);
+    TEST_ASSERT_EQUAL_UINT16(25, frames[0].pm_standard[1]);
+    TEST_ASSERT_EQUAL_UINT16(26, frames[0].pm_atmospheric[1]);
+    TEST_ASSERT_EQUAL_UINT16(700, frames[0].particles[0]);
+    TEST_ASSERT_EQUAL_UINT8(0x97, frames[0].version);
+    TEST_ASSERT_EQUAL_UINT8(0, frames[0].error_code);
+    TEST_ASSERT_EQUAL_UINT32(1, parser.getCounters().frames);
+}
+
+void test_skips_garbage_between_frames() {
+    std::mt19937 rng(1);
+    std::vector<uint8_t> stream;
+    for (uint16_t i = 0; i < 50; i++) {
+        const size_t garbage = rng() % 40;
+        for (size_t j = 0; j < garbage; j++) stream.push_back(static_cast<uint8_t>(rng()));
+        append(stream, makeFrame(i));
+    }
+
+    PMS5003Parser parser;
+    const auto frames = feed(parser, stream, 17);
+
+    TEST_ASSERT_EQUAL(50, frames.size());
+    for (uint16_t i = 0; i < 50; i++) TEST_ASSERT_EQUAL_UINT16(i, frames[i].pm_standard[1]);
+    TEST_ASSERT_GREATER_THAN(0, parser.getCounters().skipped_bytes);
+}
+
+void test_rejects_corrupted_length() {
+    std::vector<uint8_t> stream = makeFrame(10);
+    stream[3] = 0x1D;
+    append(stream, makeFrame(11));
+
+    PMS5003Parser parser;
+    const auto frames = feed(parser, stream, 64);
+
+    TEST_ASSERT_EQUAL(1, frames.size());
+    TEST_ASSERT_EQUAL_UINT16(11, frames[0].pm_standard[1]);
+    TEST_ASSERT_EQUAL_UINT32(1, parser.getCounters().length_errors);
+}
+
+void test_rejects_corrupted_checksum() {
+    std::vector<uint8_t> stream = makeFrame(10);
+    stream[31] ^= 0x01;
+    append(stream, makeFrame(11));
+    std::vector<uint8_t> flipped = makeFrame(12);
+    flipped[9] ^= 0x40;
+    append(stream, flipped);
+    append(stream, makeFrame(13));
+
+    PMS5003Parser parser;
+    const auto frames = feed(parser, stream, 64);
+
+    TEST_ASSERT_EQUAL(2, frames.size());
+    TEST_ASSERT_EQUAL_UINT16(11, frames[0].pm_standard[1]);
+    TEST_ASSERT_EQUAL_UINT16(13, frames[1].pm_standard[1]);
+    TEST_ASSERT_EQUAL_UINT32(2, parser.getCounters().checksum_errors);
+}
+
+void test_frames_split_at_every_byte_boundary() {
+    std::vector<uint8_t> stream = makeFrame(1);
+    append(stream, makeFrame(2));
+
+    for (size_t split = 1; split < stream.size(); split++) {
+        Ring ring;
+        PMS5003Parser parser;
+        PMS5003Frame frame{};
+        std::vector<uint16_t> decoded;
+
+        ring.write(stream.data(), split);
+        while (parser.parse(ring, frame)) decoded.push_back(frame.pm_standard[1]);
+        ring.write(stream.data() + split, stream.size() - split);
+        while (parser.parse(ring, frame)) decoded.push_back(frame.pm_standard[1]);
+
+        TEST_ASSERT_EQUAL(2, decoded.size());
+        TEST_ASSERT_EQUAL_UINT16(1, decoded[0]);
+        TEST_ASSERT_EQUAL_UINT16(2, decoded[1]);
+    }
+
+    // One byte at a time, which also walks every frame across the ring's wrap point.
+    PMS5003Parser parser;
+    TEST_ASSERT_EQUAL(2, feed(parser, stream, 1).size());
+}
+
+void test_fuzz_only_intact_frames_are_decoded() {
+    std::mt19937 rng(7);
+    std::vector<uint8_t> stream;
+    std::vector<uint16_t> expected;
+
+    for (uint16_t i = 0; i < 2000; i++) {
+        if (rng() % 4 == 0) {
+            for (size_t j = rng() % 64; j > 0; j--) stream.push_back(static_cast<uint8_t>(rng()));
+        }
+        std::vector<uint8_t> frame = makeFrame(i % 1000);
+        if (rng() % 5 == 0) {
+            frame[rng() % frame.size()] ^= static_cast<uint8_t>(1 + rng() % 255);
+        } else {
+            expected.push_back(i % 1000);
+        }
+        append(stream, frame);
+    }
+
+    for (size_t chunk : { 1, 5, 31, 32, 33, 200 }) {
+        PMS5003Parser parser;
+        const auto frames = feed(parser, stream, chunk);
+        TEST_ASSERT_EQUAL(expected.size(), frames.size());
+        for (size_t i = 0; i < frames.size(); i++) {
+            TEST_ASSERT_EQUAL_UINT16(expected[i], frames[i].pm_standard[1]);
+        }
+    }
+}
+
+void test_throughput() {
+    std::vector<uint8_t> stream;
+    for (uint16_t i = 0; i < 4; i++) append(stream, makeFrame(i));
+
+    constexpr size_t rounds = 100000;
+    Ring ring;
+    PMS5003Parser parser;
+    PMS5003Frame frame{};
+    size_t frames = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t round = 0; round < rounds; round++) {
+        ring.write(stream.data(), stream.size());
+        while (parser.parse(ring, frame)) frames++;
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    TEST_ASSERT_EQUAL(rounds * 4, frames);
+    char message[96];
+    snprintf(message, sizeof(message), "PMS5003 parser: %.1f MB/s, %.2f M frames/s",
+             rounds * stream.size() / seconds / 1e6, frames / seconds / 1e6);
+    TEST_MESSAGE(message);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_decodes_a_frame);
+    RUN_TEST(test_skips_garbage_between_frames);
+    RUN_TEST(test_rejects_corrupted_length);
+    RUN_TEST(test_rejects_corrupted_checksum);
+    RUN_TEST(test_frames_split_at_every_byte_boundary);
+    RUN_TEST(test_fuzz_only_intact_frames_are_decoded);
+    RUN_TEST(test_throughput);
+    return UNITY_END();
+}
@@ -0,0 +1,145 @@
+#include <unity.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include "AqiEngine.h"
+#include "HistoryStore.h"
+#include "OnlineStats.h"
+#include "SensorScheduler.h"
+#include "ha/Sensor.h"
+
+// Every heap allocation in the test binary is counted here.
+static std::atomic<size_t> allocations{0};
+
+void* operator new(size_t size) {
+    allocations++;
+    if (void* block = std::malloc(size ? size : 1)) return block;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* block) noexcept {
+    std::free(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+    std::free(block);
+}
+
+class FakeClimate : public SensorDriver {
+public:
+    static constexpr const char* name = "Climate";
+    static constexpr std::array<SensorEntity, 0> entities = {};
+    uint32_t reads = 0;
+
+    bool begin() { return true; }
+
+    ReadStatus read(uint32_t now, SampleFrame& frame) {
+        reads++;
+        frame.set(MeasurementType::Temperature, 21 + (reads % 7) * 0.01, now);
+        frame.set(MeasurementType::Humidity, 45 + (reads % 5) * 0.1, now);
+        return ReadStatus::Ok;
+    }
+};
+
+class FakeParticles : public SensorDriver {
+public:
+    static constexpr const char* name = "Particles";
+    static constexpr std::array<SensorEntity, 0> entities = {};
+    uint32_t reads = 0;
+
+    bool begin() { return true; }
+
+    uint32_t wake() { return 500; }
+
+    ReadStatus read(uint32_t now, SampleFrame& frame) {
+        reads++;
+        frame.set(MeasurementType::PM1, 3 + reads % 3, now);
+        frame.set(MeasurementType::PM25, 6 + reads % 4, now);
+        frame.set(MeasurementType::PM10, 9 + reads % 5, now);
+        return ReadStatus::Ok;
+    }
+};
+
+static FakeClimate climate;
+static FakeParticles particles;
+static SensorSet<FakeClimate, FakeParticles> sensors(climate, particles);
+static SampleFrame measurements;
+static MeasurementStatistics statistics;
+static HistoryStore history;
+static AqiEngine aqi;
+
+static uint32_t now_millis = 0;
+static uint32_t now_seconds = 1750000000;
+
+// What the sensor task does with every reading, minus the locks and the flash log.
+static void runCycles(ha::Sensor& health_sensor, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        now_millis += 1000;
+        now_seconds += 60;
+        sensors.tick(now_millis, [&](const SensorReading& reading) {
+            statistics.add(reading.sample);
+            if (!reading.published.empty()) {
+                measurements.merge(reading.published);
+                history.add(reading.published, now_seconds);
+                aqi.add(reading.published, now_seconds);
+            }
+
+            char health[96];
+            const size_t length = sensors.formatHealth(health, sizeof(health));
+            health_sensor.updateState(std::string_view(health, length));
+        });
+    }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_allocations_are_counted() {
+    const size_t before = allocations.load();
+    std::string text(64, 'x');
+    TEST_ASSERT_EQUAL(before + 1, allocations.load());
+}
+
+void test_health_text() {
+    char health[96];
+    sensors.begin([](const char*) {});
+    TEST_ASSERT_EQUAL(26, sensors.formatHealth(health, sizeof(health)));
+    TEST_ASSERT_EQUAL_STRING("Climate: OK, Particles: OK", health);
+}
+
+void test_sensor_cycle_does_not_allocate() {
+    ha::Device device("smaq_", "001122334455", "Test", "0");
+    ha::Sensor health_sensor(device, "sensor_health", "Sensor Health", "", "");
+    sensors.configure<FakeClimate>(SensorSchedule{ 1000 });
+    sensors.configure<FakeParticles>(SensorSchedule{ 1000 });
+
+    // The first cycles size the health text's buffer.
+    runCycles(health_sensor, 10);
+
+    constexpr size_t cycles = 20000;
+    const size_t before = allocations.load();
+    const auto start = std::chrono::steady_clock::now();
+    runCycles(health_sensor, cycles);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const size_t allocated = allocations.load() - before;
+
+    char message[96];
+    snprintf(message, sizeof(message), "Sensor cycle: %zu allocations in %zu cycles, %.0f ns per cycle",
+             allocated, cycles, seconds / cycles * 1e9);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL(0, allocated);
+    TEST_ASSERT_GREATER_OR_EQUAL(cycles, climate.reads);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_allocations_are_counted);
+    RUN_TEST(test_health_text);
+    RUN_TEST(test_sensor_cycle_does_not_allocate);
+    return UNITY_END();
+}
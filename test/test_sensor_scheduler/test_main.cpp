@@ -0,0 +1,154 @@
+#include <unity.h>
+
+#include <vector>
+
+#include "SensorScheduler.h"
+
+// Driver whose timing is set by the test. Every call is recorded with the virtual time.
+template <int Id>
+class FakeDriver : public SensorDriver {
+public:
+    static constexpr const char* name = "fake";
+    static constexpr std::array<SensorEntity, 1> entities = {{
+        { MeasurementType::Temperature, "fake", "Fake", "", "" }
+    }};
+
+    uint32_t settle_millis = 0;
+    bool never_ready = false;
+    uint32_t now = 0;
+    std::vector<uint32_t> wakes;
+    std::vector<uint32_t> reads;
+    uint32_t sleeps = 0;
+
+    bool begin() { return true; }
+
+    uint32_t wake() {
+        wakes.push_back(now);
+        return settle_millis;
+    }
+
+    ReadStatus read(uint32_t read_now, SampleFrame& frame) {
+        if (never_ready) return ReadStatus::Pending;
+        reads.push_back(read_now);
+        frame.set(MeasurementType::Temperature, 21.5, read_now);
+        return ReadStatus::Ok;
+    }
+
+    void sleep() { sleeps++; }
+};
+
+using Slow = FakeDriver<0>;
+using Fast = FakeDriver<1>;
+
+struct Completed {
+    size_t index;
+    uint32_t time;
+    bool ok;
+};
+
+// Ticks the set every `step` ms of virtual time from 0 to `until`.
+template <typename Set>
+static std::vector<Completed> run(Set& set, Slow& slow, Fast& fast, uint32_t until, uint32_t step = 10) {
+    std::vector<Completed> completed;
+    for (uint32_t now = 0; now <= until; now += step) {
+        slow.now = now;
+        fast.now = now;
+        set.tick(now, [&](const SensorReading& reading) {
+            completed.push_back({ reading.index, now, !reading.sample.empty() });
+        });
+    }
+    return completed;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_long_settle_does_not_delay_other_sensors() {
+    Slow slow;
+    Fast fast;
+    slow.settle_millis = 30000;
+    fast.settle_millis = 80;
+
+    SensorSet<Slow, Fast> set(slow, fast);
+    set.configure<Slow>(SensorSchedule{ 60000 });
+    set.configure<Fast>(SensorSchedule{ 1000 });
+
+    const std::vector<Completed> completed = run(set, slow, fast, 30000);
+
+    TEST_ASSERT_EQUAL(1, slow.reads.size());
+    TEST_ASSERT_EQUAL_UINT32(30000, slow.reads[0]);
+    TEST_ASSERT_EQUAL(30, fast.reads.size());
+    TEST_ASSERT_EQUAL_UINT32(80, fast.reads[0]);
+    TEST_ASSERT_EQUAL_UINT32(29080, fast.reads.back());
+    TEST_ASSERT_EQUAL(31, completed.size());
+    TEST_ASSERT_EQUAL(0, completed.back().index);
+}
+
+void test_each_sensor_keeps_its_period() {
+    Slow slow;
+    Fast fast;
+    slow.settle_millis = 500;
+    fast.settle_millis = 80;
+
+    SensorSet<Slow, Fast> set(slow, fast);
+    set.configure<Slow>(SensorSchedule{ 5000 });
+    set.configure<Fast>(SensorSchedule{ 1000 });
+
+    run(set, slow, fast, 20000);
+
+    TEST_ASSERT_EQUAL(5, slow.wakes.size());
+    for (size_t i = 0; i < slow.wakes.size(); i++) TEST_ASSERT_EQUAL_UINT32(i * 5000, slow.wakes[i]);
+    TEST_ASSERT_EQUAL(21, fast.wakes.size());
+    for (size_t i = 0; i < fast.wakes.size(); i++) TEST_ASSERT_EQUAL_UINT32(i * 1000, fast.wakes[i]);
+    TEST_ASSERT_EQUAL_UINT32(fast.reads.size(), fast.sleeps);
+}
+
+void test_tick_reports_when_the_next_sensor_is_due() {
+    Slow slow;
+    Fast fast;
+    slow.settle_millis = 30000;
+    fast.settle_millis = 80;
+
+    SensorSet<Slow, Fast> set(slow, fast);
+    set.configure<Slow>(SensorSchedule{ 60000 });
+    set.configure<Fast>(SensorSchedule{ 1000 });
+
+    auto ignore = [](const SensorReading&) {};
+    TEST_ASSERT_EQUAL_UINT32(80, set.tick(0, ignore));
+    TEST_ASSERT_EQUAL_UINT32(920, set.tick(80, ignore));
+}
+
+void test_pending_read_times_out() {
+    Slow slow;
+    Fast fast;
+    slow.settle_millis = 1000;
+    slow.never_ready = true;
+
+    SensorSet<Slow, Fast> set(slow, fast);
+    set.configure<Slow>(SensorSchedule{ 60000 });
+    set.configure<Fast>(SensorSchedule{ 60000 });
+    set.begin([](const char*) {});
+    TEST_ASSERT_TRUE(set.isHealthy(0));
+
+    std::vector<Completed> completed = run(set, slow, fast, 10000);
+
+    size_t slow_results = 0;
+    for (const Completed& result : completed) {
+        if (result.index != 0) continue;
+        slow_results++;
+        TEST_ASSERT_FALSE(result.ok);
+        TEST_ASSERT_EQUAL_UINT32(1000 + 5000, result.time);
+    }
+    TEST_ASSERT_EQUAL(1, slow_results);
+    TEST_ASSERT_FALSE(set.isHealthy(0));
+    TEST_ASSERT_EQUAL_UINT32(1, slow.sleeps);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_long_settle_does_not_delay_other_sensors);
+    RUN_TEST(test_each_sensor_keeps_its_period);
+    RUN_TEST(test_tick_reports_when_the_next_sensor_is_due);
+    RUN_TEST(test_pending_read_times_out);
+    return UNITY_END();
+}